@@ -13,10 +13,10 @@
 
 #include <vector>
 #include <iostream>
-#include <fstream>
 
 #include "stopwatch.h"
 #include "t_mesh2d.h"
+#include "t_mesh2d_front.h"
 #include "bc2d.h"
 #include "getpot.h"
 
@@ -34,18 +34,25 @@ int main( int argc, char* argv[] )
    //const bool show = !cmd_ln.search( "-n" );
    const char* ifile = cmd_ln.follow( (char*) 0, 2, "-i","--ifile");
    const char* ofile = cmd_ln.follow( (char*) 0, 2, "-o","--ofile");
+   const char* bfile = cmd_ln.follow( (char*) 0, 2, "-b","--bfront");   // save binary front
+   const int   chunk = cmd_ln.follow( 0, 2, "-c","--out-of-core");      // records per chunk
+   const int   parts = cmd_ln.follow( 0, 2, "-p","--parts");            // parallel pieces
+   const int   nthrd = cmd_ln.follow( 0, 2, "-t","--threads");          // 0: one per core
+   const bool  star  = cmd_ln.search( 2, "-r","--star");                // star insertion
+   const char* sgrid = cmd_ln.follow( (char*) 0, 2, "-s","--size-grid"); // user spacing
+   const double beta = cmd_ln.follow( 0.0, 2, "-g","--gradation");       // spacing growth rate
 
    if( ifile == 0 )
    {
      cout << "input file not supplied" << endl;
-     cout << "mesh2d_fist -i infile -o outfile" << endl;
+     cout << "mesh2d_fist -i infile -o outfile [-b binary_front] [-c chunk | -p parts [-t threads]] [-r] [-s size_grid] [-g gradation]" << endl;
      exit(1);
    }
 
    if( ofile == 0 )
    {
      cout << "output file not supplied" << endl;
-     cout << "mesh2d_fist -i infile -o outfile" << endl;
+     cout << "mesh2d_fist -i infile -o outfile [-b binary_front] [-c chunk | -p parts [-t threads]] [-r] [-s size_grid] [-g gradation]" << endl;
      exit(1);
    }
 
@@ -53,43 +60,38 @@ int main( int argc, char* argv[] )
    stopwatch sw;
 
    m.set_dumping( false );
+   if( chunk > 0 && parts > 1 )
+   {
+     cout << "out-of-core and parallel generation can not be combined" << endl;
+     exit(1);
+   }
+   if( chunk > 0 )
+      m.set_out_of_core( chunk );
+   m.set_star_insertion( star );
+   if( sgrid != 0 && !m.load_size_grid( sgrid ) )
+      exit(-1);
+   m.set_gradation( beta );
    //~ m.set_dump_dir( "./" );
 
-   std::ifstream fs;
+   front_list fronts;
+   bool ok;
 
-   fs.open( ifile );
-   if ( !fs )
+   if( is_front_binary( ifile ) )
+      ok = read_front_binary( ifile, fronts );
+   else
+      ok = read_front_text( ifile, fronts );
+
+   if( !ok )
    {
-      std::cerr << "erro na abertura do ficheiro da frente" << std::endl;
+      std::cerr << "erro na leitura do ficheiro da frente" << std::endl;
       exit(-1);
    }
 
-   double x, y;
-   int bc_type = 1, bc_index = 0, bc_surface = 0, n_pts, n_frts;
+   if( bfile != 0 && !write_front_binary( bfile, fronts ) )
+      exit(-1);
 
-   fs >> n_frts;
-
-   for( int f = 0; f < n_frts; f++ )
-   {
-     fs >> n_pts;
-
-     m.begin_front();
-     for( int j = 0 ; j < n_pts ; j++ )
-     {
-        fs >> x >> y >> bc_type;
-
-        if( j != n_pts-1 )
-           m.add_to_front( x, y, 0.0, bc_type, bc_index, bc_surface );
-
-        if( !fs )
-        {
-           std::cout << "erro na leitura do ficheiro da frente (" << f << ")" << std::endl;
-           exit(-1);
-        }
-     }
-     m.end_front();
-   }
-   fs.close();
+   add_fronts( m, fronts );
+   fronts.clear();
 
    sw.start();
    //~ m.dump_links();
@@ -98,20 +100,29 @@ int main( int argc, char* argv[] )
    printf( "elapsed time = %.2fs\n", sw.stop() );
 
    sw.start();
-   m.mesh_generation();
+   if( parts > 1 )
+      m.parallel_generation( parts, nthrd );
+   else
+      m.mesh_generation();
    printf( "elapsed time = %.2fs\n", sw.stop() );
 
-   m.testing_mesh();
+   //
+   // the spilled cells are no longer in memory to be tested or smoothed
+   //
+   if( !m.is_out_of_core() )
+   {
+      m.testing_mesh();
+
+      //~ m.dump_mesh();
+      //~ m.dump_back();
+      //~ m.dump_bad_cells();
 
-   //~ m.dump_mesh();
-   //~ m.dump_back();
-   //~ m.dump_bad_cells();
-
-   m.smooth();
-   m.smooth();
-   m.smooth();
-   m.smooth();
-   m.smooth();
+      m.smooth();
+      m.smooth();
+      m.smooth();
+      m.smooth();
+      m.smooth();
+   }
    //~ m.dump_mesh();
 
    FILE* stream = fopen( ofile, "w+" );
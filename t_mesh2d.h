@@ -12,8 +12,10 @@
 
 #include <functional>
 #include <list>
+#include <mutex>
 #include <stdio.h>
 #include <set>
+#include <vector>
 #include <math.h>
 #include "efread.h"
 #include "common.h"
@@ -29,6 +31,7 @@ extern const int SUC2D[3][2];
 struct face2d;
 struct cell2d;
 struct link2d;
+struct edge2d;
 
 struct p2d
 {
@@ -51,10 +54,12 @@ struct node2d
 
    double    param;
    double    h;             // spacing function
+   double    m[3];          // metric tensor m11 m12 m22, 0 if isotropic
    double    degree;
+   unsigned  mark;          // search epoch stamp
 
-   node2d( int _id = -1 )    { id = _id; head = 0; degree = param = h = 0.0; bc_type = bc_index = bc_surface = 0; }
-   node2d( int _id, p2d *q ) { id = _id; head = 0; p = *q; degree = param = h = 0.0; bc_type = bc_index = bc_surface = 0; }
+   node2d( int _id = -1 )    { id = _id; head = 0; degree = param = h = 0.0; bc_type = bc_index = bc_surface = 0; mark = 0; m[0] = m[1] = m[2] = 0.0; }
+   node2d( int _id, p2d *q ) { id = _id; head = 0; p = *q; degree = param = h = 0.0; bc_type = bc_index = bc_surface = 0; mark = 0; m[0] = m[1] = m[2] = 0.0; }
 };
 
 struct link2d
@@ -63,10 +68,12 @@ struct link2d
    link2d     *next;
    link2d     *prev;
    face2d     *adj;
+   edge2d     *edge;       // frontal edge of the face inside the front
    double      angle;
    int         id;
+   unsigned    mark;       // search epoch stamp
 
-   link2d( int _id ) { id = _id; }
+   link2d( int _id = 0 ) { id = _id; mark = 0; edge = 0; }
 };
 
 struct face2d
@@ -77,6 +84,7 @@ struct face2d
    node2d  *mid_node;      // mid node of this face
    face2d  *adj;           // adjacent cell to this face
    face2d  *next;          // next cell owning the node
+   edge2d  *edge;          // frontal edge attached to this face
    int      orientation;
    p2d      normal;
 };
@@ -90,11 +98,18 @@ struct cell2d
    double  area;
    double  dh_dx;         // spacing function gradient
    double  dh_dy;
+   double  hp[3];         // background spacing plane, h = hp[0] + hp[1] x + hp[2] y
    bool    bad;
    int     id;
+   int     slot;          // position in fist2d::bad_array, -1 if not bad
+   unsigned mark;         // search epoch stamp
    double  max_length;
 
-   cell2d( int _id )
+   cell2d( int _id ) { reset( _id ); }
+   //
+   // back to the state of a new cell, for the cells reused by the insertion
+   //
+   void reset( int _id )
    {
       for( int i = 0 ; i < 3 ; i++ )
       {
@@ -105,11 +120,15 @@ struct cell2d
          face[i].adj = 0;
          face[i].orientation = 0;
          face[i].next = 0;
+         face[i].edge = 0;
       }
       max_length = xc = yc = rc = area = 0.0;
       bad = true;
       id = _id;
+      slot = -1;
+      mark = 0;
       dh_dx = dh_dy = 0.0;
+      hp[0] = hp[1] = hp[2] = 0.0;
    }
 };
 
@@ -164,29 +183,47 @@ struct smaller_eaddr
    }
 };
 
+//
+// h and ro are compared after rounding to a 2^-40 relative precision, about
+// the old 1E-12 relative tolerance, which keeps a strict weak ordering for
+// std::sort and needs no divisions
+//
 struct smaller_eht
 {
+   static double round_rel( double a )
+   {
+      int e;
+      double m = frexp( a, &e );
+      return ldexp( floor( m * 1099511627776.0 + 0.5 ), e - 40 );
+   }
+
    bool operator () ( edge2d* a, edge2d* b ) const
    {
-      double hrel = ( a->h - b->h ) / ( a->h + b->h );
-      if( fabs( hrel ) <= 1E-12 )
+      double ha = round_rel( a->h ), hb = round_rel( b->h );
+      if( ha == hb )
       {
-#if 0
-         double trel = ( a->theta - b->theta ) / ( a->theta + b->theta );
-         if( fabs( trel ) <= 1E-12 )
-            return( a->ro < b->ro );                      // thirdary key
-         else
-            return( a->theta < b->theta );                // secundary key
-#else
-         double rrel = ( a->ro - b->ro ) / ( a->ro + b->ro );
-         if( fabs( rrel ) <= 1E-12 )
+         double ra = round_rel( a->ro ), rb = round_rel( b->ro );
+         if( ra == rb )
             return( a->theta < b->theta );                // thirdary key
          else
-            return( a->ro < b->ro );                      // secundary key
-#endif
+            return( ra < rb );                            // secundary key
       }
       else
-         return( a->h < b->h );                           // primary key
+         return( ha < hb );                               // primary key
+   }
+};
+
+//
+// the cell id breaks the ties, the addresses change from run to run
+//
+struct smaller_sample
+{
+   bool operator () ( const pair<double,cell2d*>& a, const pair<double,cell2d*>& b ) const
+   {
+      if( a.first == b.first )
+         return( a.second->id < b.second->id );
+      else
+         return( a.first < b.first );
    }
 };
 
@@ -198,6 +235,82 @@ struct smaller_cell
    }
 };
 
+//
+// Flat arrays filled by mesh2d::export_arrays. The buffers are owned by the
+// caller and sized from mesh2d::get_export_sizes; a null pointer skips the
+// array. All indices are zero based, triangles are counter-clockwise and
+// entry k of a cell refers to the edge opposite to its vertex k.
+//
+struct mesh2d_arrays
+{
+   double  *xy;           // [2*nodes]   node coordinates
+   int     *node_bc;      // [nodes]     node bc_type
+   int     *tri;          // [3*cells]   triangle connectivity
+   int     *neighbour;    // [3*cells]   adjacent cell, -1 at the boundary
+   int     *bface;        // [2*bfaces]  boundary face nodes
+   int     *bface_cell;   // [bfaces]    cell owning the boundary face
+   int     *bface_type;   // [bfaces]    boundary face bc_type
+   int     *mid;          // [3*cells]   edge mid node, numbered after the vertices
+   double  *mid_xy;       // [2*mids]    mid node coordinates (convert_to_tri6)
+
+   mesh2d_arrays() { xy = mid_xy = 0; node_bc = tri = neighbour = bface = bface_cell = bface_type = mid = 0; }
+};
+
+//
+// Records of the out-of-core store, see mesh2d::set_out_of_core. Node ids
+// are the generation ids, renumbered when the mesh is saved.
+//
+struct spill_node2d
+{
+   int      id;
+   double   x, y;
+};
+
+struct spill_cell2d
+{
+   int      node[3];      // in the save_gmsh order
+};
+
+struct spill_face2d
+{
+   int      node[2];      // boundary face, in the save_gmsh order
+   int      bc_type;
+};
+
+//
+// User spacing, see mesh2d::add_line_source and mesh2d::load_size_grid
+//
+struct size_source
+{
+   double   x0, y0, x1, y1;  // segment, a point when both ends are equal
+   double   h;               // spacing up to the distance r
+   double   r;
+   double   growth;          // spacing increase per unit of distance beyond r
+};
+
+struct size_grid
+{
+   int            nx, ny;
+   double         x0, y0, dx, dy;
+   vector<double> h;         // nx * ny values, x varies first
+
+   size_grid() { nx = ny = 0; x0 = y0 = dx = dy = 0.0; }
+};
+
+//
+// Point location grid, see mesh2d::build_cell_grid: a cell is listed in
+// every bucket its bounding box overlaps.
+//
+struct cell_grid
+{
+   int              nx, ny;
+   double           x0, y0, dx, dy;
+   vector<int>      start;    // nx * ny + 1 offsets in cells, x varies first
+   vector<cell2d*>  cells;
+
+   cell_grid() { nx = ny = 0; x0 = y0 = dx = dy = 0.0; }
+};
+
 typedef list<node2d*>                  node2d_list;
 typedef set<cell2d*, smaller_cell>     cell2d_set;
 
@@ -259,7 +372,9 @@ public:
 
    void load( FILE*, void(*progress)(int) = 0 );
    void save( FILE*, void(*progress)(int) = 0 );
-   void save_gmsh( FILE*, void(*progress)(int) = 0 );
+   virtual void save_gmsh( FILE*, void(*progress)(int) = 0 );
+   void save_vtu( FILE*, const int *partition = 0, bool compress = false,
+                  void(*progress)(int) = 0 );
 
    mesh2d_base( node2d* (*ndalloc)(int) = 0, cell2d* (*clalloc)(int) = 0,
                 link2d* (*lkalloc)(int) = 0, edge2d* (*edalloc)() = 0 );
@@ -282,8 +397,13 @@ protected:
 
    front2d           front;
    cell2d_set        bad_cells;           // stores the bad mesh cells
+   vector<cell2d*>   bad_array;           // bad_cells in a contiguous array
+                                          // - sampled by the point location
    node2d_list       mid_nodes;
 
+   vector<node2d*>   node_blocks;         // storage of the bulk loaded fronts
+   vector<link2d*>   link_blocks;         // - never deleted one by one
+
    void     initialization();
    void     classify_store_link( link2d *cl );
    bool     reflex_nodes_in_cell( link2d *vim1, link2d *vi, link2d *vip1 );
@@ -295,6 +415,9 @@ protected:
    void     add_length( link2d *l );
    bool     join_fronts();
 
+   void     insert_bad_cell( cell2d *c );
+   void     erase_bad_cell( cell2d *c );
+
    virtual  void  attach_bad_edges( cell2d * ) {}
 
 public:
@@ -305,17 +428,21 @@ public:
 
    void     end_front();
 
+   void     add_front( int n, const double *x, const double *y, const int *bc_type,
+                       const int *bc_index = 0, const int *bc_surface = 0,
+                       const double *param = 0 );
+
    bool     fist_generation ();
 
             fist2d( node2d* (*ndalloc)(int) = 0, cell2d* (*clalloc)(int) = 0,
                     link2d* (*lkalloc)(int) = 0, edge2d* (*edalloc)() = 0 );
-   virtual ~fist2d() {}
+   virtual ~fist2d();
 };
 
 class mesh2d : public fist2d
 {
 protected:
-   typedef set<edge2d*, smaller_eht>      edge2d_set_sort;
+   typedef vector<edge2d*>                edge2d_list;
 
    cell2d_set      back_mesh;           // stores the background mesh cells
 
@@ -324,44 +451,286 @@ protected:
 
    edge2d_set_addr   frontal_edges;       // global front sorted by edge addr
                                           // - used to find an edge in global_front_size
+   edge2d_list       frontal_sort;        // candidate edges sorted by smaller_eht
+   edge2d_list       neighbours;          // near candidates in create_frontal_edges
+   cell2d_set        implicit_cand;       // bad cells that may become implicit
+   int               implicit_id;         // the cells above it are new since implicit_cells
 
    cell2d           *back_start;
+   vector<cell2d*>   back_array;          // back_mesh cells, walk starts of find_back_cell
+
+   cell_grid         locate_grid;         // mesh_cells grid of locate, built on demand
+   std::mutex        locate_mutex;
+   int               locate_cells;        // mesh_cells size, cur_cell_id and cur_node_id
+   int               locate_cell_id;      // - when the grid was built
+   int               locate_node_id;
+
+   unsigned          walk_seed;           // pseudo random state of the point location
+   vector<pair<double,cell2d*> > walk_samples;   // sorted by smaller_sample
+
+   unsigned          epoch;               // current search stamp of cells, links and nodes
+   vector<face2d*>   face_stack;          // reusable search storage
+   vector<cell2d*>   cell_stack;
+   vector<link2d*>   link_heap;
+   vector<link2d*>   link_stack;
 
    const char* dump_dir;
    bool dumping_enable;
+   bool star_insertion;                   // connect the new node to the cavity
+                                          // - FIST re-triangulation otherwise
+
+   cell2d            spill_cell;          // adjacent to the spilled cells, never
+   node2d            spill_node;          // - inside a circle nor near a node
+   int               spill_chunk;         // records per write, 0 if in memory
+   FILE             *spill_nodes_file;    // out-of-core store
+   FILE             *spill_cells_file;
+   FILE             *spill_faces_file;
+   int               spill_num_nodes;
+   int               spill_num_cells;
+   int               spill_num_faces;
+   vector<spill_node2d>  spill_nodes_buf;
+   vector<spill_cell2d>  spill_cells_buf;
+   vector<spill_face2d>  spill_faces_buf;
+
+   double  (*size_func)( double x, double y, void *data );
+   void             *size_data;
+   vector<size_source>  size_sources;
+   size_grid         back_grid;
+   double            gradation;           // largest spacing growth rate, 0 if free
+   void    (*metric_func)( double x, double y, double m[3], void *data );
+   void             *metric_data;
 
    bool     check_dump_dir();
-
-   double   interpolate( cell2d *bc, node2d *n2 );
+   unsigned next_epoch();
+
+   void     set_back_spacing( cell2d *cb );
+   void     limit_gradation();
+   double   interpolate( cell2d *bc, node2d *n2 ) { return( bc->hp[0] + bc->hp[1] * n2->p.x + bc->hp[2] * n2->p.y ); }
+   bool     has_user_size() { return( size_func != 0 || !size_sources.empty() || back_grid.nx > 0 ); }
+   double   user_size( double x, double y );
+   void     set_back_metric();
+   void     metric_at( cell2d *cb, double x, double y, double m[3] );
+   void     new_point_metric( edge2d* be, cell2d *cb );
    void     new_point( edge2d* be );
    bool     is_implicit( cell2d *c, int type );
    bool     is_frontal_face( face2d *f );
    bool     is_close_to_existing_node( cell2d *c, node2d *n );
    bool     is_point_allowed( cell2d *c, node2d *n );
    bool     is_close_to_frontal_face( cell2d *c, node2d *n );
-
+   bool     is_flat_on_boundary( cell2d *c, node2d *n );
+
+   static unsigned walk_random( unsigned& s ) { return( s = s * 1103515245u + 12345u ) >> 16; }
+   unsigned walk_random() { return walk_random( walk_seed ); }
+   cell2d*  step_around_boundary( cell2d *c, int bf, node2d *n );
+   cell2d*  walk_cell( cell2d *c, node2d *n, unsigned& seed );
+   cell2d*  walk_cell( cell2d *c, node2d *n ) { return walk_cell( c, n, walk_seed ); }
+   cell2d*  jump_and_walk( node2d *n );
    cell2d*  find_cell( cell2d_set* set, cell2d *c, node2d *n );
    cell2d*  find_back_cell( node2d *n );
    cell2d*  find_bad_cell( cell2d *c, node2d *n );
+   void     build_cell_grid( cell_grid& g, int threads );
+   cell2d*  grid_cell( const cell_grid& g, node2d *n, bool& inside );
+   void     clear_locate_grid();
 
    bool     green_sibson( face2d *f1 );
    void     create_fist_front( cell2d *c, node2d *n );
+   bool     create_star_cells( node2d *n );
+   void     insert_point( edge2d *be );
+   void     delete_cavity_cells();
    void     create_new_cell( edge2d *be, node2d *n );
    void     create_frontal_edges();
+   void     clear_frontal_edges();
+   void     spill_cells();
+   void     flush_spill();
    void     detach_bad_edges( cell2d *c );
    virtual  void  attach_bad_edges( cell2d *c );
 
    void     centroide();
    void     create_back_mesh();
+   void     set_back_planes();
    void     implicit_cells();
    bool     make_delaunay( cell2d_set* );
+   void     smooth_region( cell2d_set& s, int first_node );
+   void     smooth_interface( vector<node2d*>& seeds );
+   bool     collapse_edge( face2d *f, node2d *a, node2d *b, unsigned dead, unsigned dropped,
+                           vector<cell2d*>& touched );
+   int      collapse_short_edges();
+   void     refine_level( tri6_xda_interpolator *bi, vector<int> *node_parent, int threads );
 
 public:
    bool     mesh_generation ();
+   //
+   // Domain decomposition, after fist_generation: the boundary triangulation
+   // is cut in `parts` pieces of about the same expected number of cells, the
+   // cuts are discretized with the spacing both pieces interpolate and each
+   // piece is meshed by its own mesh2d on `threads` threads (0: one per
+   // core). The pieces are stitched back into this mesh through the shared
+   // cut nodes and the band around the cuts is flipped and smoothed. In
+   // memory only, not with set_out_of_core.
+   // The mesh depends on `parts` only, never on `threads` nor on the timing:
+   // each piece is meshed serially and the pieces are stitched in piece
+   // order. It is not the mesh_generation mesh, also with one thread; the
+   // parallel meshes are their own baseline, one per number of parts.
+   //
+   bool     parallel_generation( int parts, int threads = 0 );
+   //
+   // Local remeshing of a generated mesh: the cells with the centroid inside
+   // the polygon x,y (n points), or the given cells, are deleted and the hole
+   // is meshed again from its boundary faces, with the spacing the boundary
+   // nodes were generated with (the edge lengths after load) and the user
+   // spacing. The faces are kept, the rest of the mesh is not changed.
+   // The fronts added with add_front before the call are meshed in the
+   // region too and replace the boundary loops lying wholly inside it, a
+   // moved part. Only the new nodes are smoothed. Not with set_out_of_core.
+   // With `split`, the boundary faces of the domain longer than split times
+   // the spacing of their ends are split on the straight face first.
+   //
+   bool     remesh_region( int n, const double *x, const double *y );
+   bool     remesh_region( const vector<cell2d*>& cells, double split = 0.0 );
+   //
+   // Adaptation of a generated mesh to a spacing per node, given in the
+   // order of the node list (get_first_node, save_gmsh). The spacing goes to
+   // node2d::h; edges shorter than 0.625 h are collapsed, also along a
+   // nearly straight boundary, in passes until none collapses, and the
+   // cells with an inner edge longer than 1.6 h are remeshed with
+   // remesh_region, the long boundary faces of the region split. The rest
+   // of the mesh is kept. adapt_to_error takes an error indicator per node
+   // instead: the spacing is the present one times
+   // ( target / error )^( 1 / order ), within a factor 4.
+   //
+   bool     adapt( const double *size );
+   bool     adapt_to_error( const double *error, double target, double order = 2.0 );
+   //
+   // Solution transfer from the mesh `from` to this one: for each node of
+   // this mesh, in the order of the node list, the index of the cell of
+   // `from` holding it, the indices of the cell nodes (node[3*i+k]) and
+   // their barycentric weights (weight[3*i+k]). The indices are those of
+   // export_arrays, the ids of `from` are renumbered the same way. A node
+   // outside `from` takes the closest point of the nearest cell. The nodes
+   // are located by from.locate on `threads` threads (0: one per core).
+   // Returns the number of nodes outside `from`, -1 on error. Null arrays
+   // are skipped. Not with set_out_of_core.
+   //
+   int      transfer_weights( mesh2d& from, int *cell, int *node, double *weight,
+                              int threads = 0 );
+   //
+   // Uniform refinement of a generated mesh: each level splits every cell
+   // in four through the mid nodes of its edges, the meshes are nested. The
+   // boundary mid nodes are put by the interpolator if given, as with
+   // convert_to_tri6, and on the straight edge otherwise; the mid nodes of
+   // a previous convert_to_tri6 are used by the first level. The mid nodes
+   // of two edges with the same bc_index pair at the ends share a new
+   // bc_index, as periodic images. The children
+   // of the cell of index p, in the order of export_arrays, are the cells
+   // 4p .. 4p+3 of the refined mesh. The new nodes come after the old ones
+   // in the node list; node_parent gets, for each node, the indices of the
+   // two ends of the edge it splits, twice its own index for the nodes of
+   // the input mesh. Runs on `threads` threads (0: one per core). Not with
+   // set_out_of_core.
+   //
+   bool     refine_uniform( int levels, tri6_xda_interpolator *bi = 0,
+                            vector<int> *node_parent = 0, int threads = 0 );
+   //
+   // Coarsening of a generated mesh by edge collapse, to about ratio times
+   // the number of cells (0.25 for each level of a multigrid hierarchy).
+   // The edges are collapsed shortest first, relative to the mean edge
+   // length of their nodes over the square root of the ratio, and one end
+   // is kept, the coarse nodes are fine nodes. The collapses keep the
+   // quality limit of adapt; a boundary node goes only along a straight
+   // enough boundary with the same bc_type and bc_surface. Two boundary
+   // nodes with the same nonzero bc_index are periodic images and are
+   // removed together, a bc_index shared by more nodes freezes them.
+   // node_map gets for each node of the input, in the order of the node
+   // list, the index of the node it went to. The ratio may not be reached
+   // when the limits stop the collapses. Not with set_out_of_core.
+   //
+   bool     coarsen( double ratio, vector<int> *node_map = 0 );
+   //
+   // Partitioning of a generated mesh in `parts` parts of about the same
+   // number of cells: part gets the part of each cell, in the order of
+   // export_arrays. Recursive bisection of the cell centroids, normal to
+   // the longer side of the bounding box or, inertial, to the principal
+   // axis of the centroids; with improve, greedy passes on the dual graph
+   // then move the cells with more neighbours in another part, within 3%
+   // of the mean size. The ranges of a level are cut on `threads` threads
+   // (0: one per core). Returns the number of faces between parts, -1 on
+   // error. Not with set_out_of_core.
+   //
+   int      partition( int parts, int *part, bool inertial = false, bool improve = true,
+                       int threads = 0 );
+   //
+   // One gmsh file per part, prefix.p.msh, with the nodes and cells of the
+   // part numbered as in save_gmsh for the whole mesh. The boundary faces
+   // have their bc_type as elementary region, the faces shared with part q
+   // have q + 1 as physical region. The files are written on `threads`
+   // threads (0: one per core).
+   //
+   bool     save_partitions( const char *prefix, const int *part, int threads = 0 );
+   //
+   // Point location: for the n points x,y the cell holding each one and the
+   // barycentric weights of its nodes, weight[3*i+k] for cell->face[k].node.
+   // A point outside the mesh gets a null cell, or with `nearest` the
+   // nearest cell and the weights of its closest point. The points are
+   // sorted along a Hilbert curve and located in blocks on `threads` threads
+   // (0: one per core), each walking from its previous hit and asking a
+   // bucket grid when the walk fails. The grid is built by the first
+   // call after the mesh changed. Concurrent calls are safe while the mesh is
+   // not modified. Returns the number of points outside the mesh, -1 on
+   // error. Null arrays are skipped. Not with set_out_of_core.
+   //
+   int      locate( int n, const double *x, const double *y, cell2d **cell,
+                    double *weight, bool nearest = false, int threads = 0 );
    bool     is_delaunay();
 
    void     set_dump_dir( const char* );
    void     set_dumping( bool b ) { dumping_enable = b; }
+   //
+   // Star insertion: the new node is connected to the edges of its cavity,
+   // which is re-triangulated by FIST only when it is not star-shaped from
+   // the node. Faster, but the meshes are not the FIST ones. Off by default.
+   //
+   void     set_star_insertion( bool b ) { star_insertion = b; }
+   //
+   // User spacing: the spacing at a point is the smallest of the background
+   // mesh spacing, from the boundary edge lengths, and the user ones. The
+   // fronts are not changed, the interior front shrinks over the cycles down
+   // to the user spacing. The function must be thread safe with
+   // parallel_generation.
+   //
+   void     set_size_function( double (*f)( double x, double y, void *data ), void *data = 0 );
+   void     add_point_source( double x, double y, double h, double r, double growth = 0.2 );
+   void     add_line_source( double x0, double y0, double x1, double y1,
+                             double h, double r, double growth = 0.2 );
+   //
+   // Text grid file: "nx ny", "x0 y0 dx dy" and the nx * ny spacings, x
+   // varying first. Bilinear, no effect outside the grid.
+   //
+   bool     load_size_grid( const char *filename );
+   //
+   // Limits the growth of the background spacing along the background mesh
+   // edges to h + beta * length, a gradient of about beta on well shaped
+   // cells. 0 leaves the spacing of the boundary edges free.
+   //
+   void     set_gradation( double beta ) { gradation = beta; }
+   //
+   // Anisotropic spacing: f returns the metric tensor m11 m12 m22 at (x,y),
+   // an edge of unit length in the metric has the wanted size. The metric
+   // of a node is the intersection of the user metric, the isotropic user
+   // spacing and the background mesh spacing; it is interpolated on the
+   // background mesh and the new points, the node distances and the
+   // Delaunay tests work in the metric of the cells. The function must be
+   // thread safe with parallel_generation.
+   //
+   void     set_metric_function( void (*f)( double x, double y, double m[3], void *data ), void *data = 0 );
+   //
+   // Out-of-core generation: after each front cycle the good cells without a
+   // bad neighbour, and the nodes no longer used by any cell in memory, are
+   // written to temporary files in chunks of `chunk` records. save_gmsh then
+   // streams them to the output. smooth, testing_mesh and the other
+   // exports only see the cells still in memory.
+   //
+   void     set_out_of_core( int chunk = 1 << 16 );
+   bool     is_out_of_core() { return spill_chunk > 0; }
    void     dump_bad_cells();
    void     dump_mesh();
    void     dump_links();
@@ -373,7 +742,7 @@ public:
 
             mesh2d( node2d* (*ndalloc)(int) = 0, cell2d* (*clalloc)(int) = 0,
                     link2d* (*lkalloc)(int) = 0, edge2d* (*edalloc)() = 0);
-   virtual ~mesh2d() {}
+   virtual ~mesh2d();
 
    cell2d_set&  get_mesh_cells_set() { return mesh_cells; }
    node2d_list& get_mesh_nodes_list() { return mesh_nodes; }
@@ -381,6 +750,19 @@ public:
 
    void convert_to_tri6( tri6_xda_interpolator& );
    void save_tri6_xda( FILE *stream );
+
+   //
+   // Expected size of the final mesh from the spacing function, valid after
+   // fist_generation: bytes is the memory taken by the nodes and cells.
+   // Within 30% of the generated counts, see check_estimate in
+   // t_mesh2d_check.cpp; the gradation is not counted before mesh_generation.
+   //
+   void estimate_mesh_size( int *nodes, int *cells, int *edges, size_t *bytes = 0 );
+
+   virtual void save_gmsh( FILE*, void(*progress)(int) = 0 );
+
+   void get_export_sizes( int *nodes, int *cells, int *bfaces, int *mids );
+   void export_arrays( mesh2d_arrays& );
 };
 
 inline void
@@ -449,6 +831,7 @@ node2d_get_next_face( face2d *ln )
 
 
 extern const double mesh_eps;
+extern const double angle_eps;
 extern const double S2min_S2max;
 extern const double S2max_S2min;
 extern const double dist_factor;
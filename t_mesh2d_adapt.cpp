@@ -0,0 +1,463 @@
+/***************************************************************************
+                            mesh generation code
+                            --------------------
+    adaptation of a generated mesh to a node spacing
+    copyright               : (C) 2001 by Joao Carlos de Campos Henriques
+    email                   : jcch@popsrv.ist.utl.pt
+ ***************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <algorithm>
+
+#include "t_mesh2d.h"
+
+using namespace mesh_2d;
+
+//
+// an edge is short below adapt_short and long above adapt_long times the
+// mean spacing of its nodes, the limits one over the other so that half
+// and twice the spacing are out of them; the generation itself leaves most
+// edges between the two
+//
+static const double adapt_short = 0.625;
+static const double adapt_long  = 1.6;
+//
+// a collapse may not spoil the cells below this quality, or below the worst
+// cell around the removed node if it is already worse
+//
+static const double collapse_quality = 0.3;
+//
+// a boundary node is removed only where the boundary turns less than about
+// 20 degrees, as in coarsen
+//
+static const double collapse_turn = 0.94;
+
+static inline double
+edge_ratio( node2d *a, node2d *b )
+{
+   return( norm( a->p.x - b->p.x, a->p.y - b->p.y ) / ( 0.5 * ( a->h + b->h ) ) );
+}
+
+struct short_edge
+{
+   double   ratio;
+   cell2d  *cell;
+   node2d  *a;
+   node2d  *b;
+};
+
+struct shorter_edge
+{
+   bool operator()( const short_edge& e1, const short_edge& e2 ) const
+   {
+      if( e1.ratio != e2.ratio )
+         return( e1.ratio < e2.ratio );
+      return( e1.cell->id < e2.cell->id );
+   }
+};
+
+//
+// Collapse of the edge a-b of the face f: the node b is removed and its
+// cells go to a. The star of b may be open only along the edge, where the
+// boundary keeps its bc_type and surface and nearly its shape, as in
+// coarsen; the periodic nodes stay. a and b may share only the nodes
+// facing the edge, no cell may fold or fall below the quality limit and
+// the new edges may not be long. A removed boundary node may belong to a
+// front block, it is marked dropped instead of dead.
+//
+bool
+mesh2d::collapse_edge( face2d *f, node2d *a, node2d *b, unsigned dead, unsigned dropped,
+                       vector<cell2d*>& touched )
+{
+   vector<cell2d*> sa, sb;
+   cell2d *c, *c1, *c2, *cc;
+   face2d *fa, *fb;
+   node2d *x, *y, *w, *o = 0;
+   unsigned ring;
+   double q_old = 1.0, q_new = 1.0;
+   bool closed;
+   int i, k, j;
+
+   c1 = f->cell;
+   c2 = ( f->adj != 0 ? f->adj->cell : 0 );
+   x  = f->node;
+   y  = ( f->adj != 0 ? f->adj->node : 0 );
+
+   closed = node_star( c1, b, sb );
+   if( !closed )
+   {
+      //
+      // along the boundary: b between a and o
+      //
+      if( c2 != 0 || b->bc_index != 0 )
+         return false;
+      for( i = 0 ; i < (int) sb.size() ; i++ )
+      {
+         c = sb[i];
+         k = node_index( c, b );
+         for( j = 0 ; j < 3 ; j++ )
+            if( j != k && c->face[j].adj == 0 && c->face[ 3 - j - k ].node != a )
+               o = c->face[ 3 - j - k ].node;
+      }
+      if( o == 0 || a->bc_index != 0 || o->bc_index != 0 ||
+          ( a->bc_type & o->bc_type ) != b->bc_type ||
+          a->bc_surface != b->bc_surface || o->bc_surface != b->bc_surface )
+         return false;
+      double ux = b->p.x - a->p.x, uy = b->p.y - a->p.y;
+      double vx = o->p.x - b->p.x, vy = o->p.y - b->p.y;
+      if( ux*vx + uy*vy < collapse_turn * norm( ux, uy ) * norm( vx, vy ) )
+         return false;
+      //
+      // the dying cell may not take the last cell of x
+      //
+      if( c1->face[ node_index( c1, a ) ].adj == 0 && c1->face[ node_index( c1, b ) ].adj == 0 )
+         return false;
+   }
+   node_star( c1, a, sa );
+
+   ring = next_epoch();
+   for( i = 0 ; i < (int) sa.size() ; i++ )
+      for( j = 0 ; j < 3 ; j++ )
+         sa[i]->face[j].node->mark = ring;
+
+   for( i = 0 ; i < (int) sb.size() ; i++ )
+   {
+      c = sb[i];
+      q_old = min( q_old, cell_quality( c ) );
+      if( c == c1 || c == c2 )
+         continue;
+      for( j = 0 ; j < 3 ; j++ )
+      {
+         w = c->face[j].node;
+         if( w == a || ( w != b && w != x && w != y && w->mark == ring ) )
+            return false;
+      }
+   }
+
+   for( i = 0 ; i < (int) sb.size() ; i++ )
+   {
+      c = sb[i];
+      if( c == c1 || c == c2 )
+         continue;
+      k = node_index( c, b );
+      c->face[k].node = a;
+      double ar = cell_area( c );
+      q_new = min( q_new, cell_quality( c ) );
+      c->face[k].node = b;
+      if( ar <= 0.0 )
+         return false;
+      for( j = 0 ; j < 3 ; j++ )
+         if( j != k && edge_ratio( a, c->face[j].node ) > adapt_long )
+            return false;
+   }
+   if( q_new < min( q_old, collapse_quality ) )
+      return false;
+
+   for( i = 0 ; i < (int) sb.size() ; i++ )
+   {
+      c = sb[i];
+      if( c == c1 || c == c2 )
+         continue;
+      c->face[ node_index( c, b ) ].node = a;
+      circun_circle( c );
+      touched.push_back( c );
+   }
+   for( i = 0 ; i < 2 ; i++ )
+   {
+      cc = ( i == 0 ? c1 : c2 );
+      if( cc == 0 )
+         continue;
+      fa = cc->face + node_index( cc, a );
+      fb = cc->face + node_index( cc, b );
+      attach_faces( fa->adj, fb->adj );
+      cc->mark = dead;
+   }
+   b->mark = ( closed ? dead : dropped );
+   return true;
+}
+
+//
+// Passes over the short edges, shortest first, until none collapses: a
+// collapse refused next to an earlier one of the pass is tried again with
+// the new cells.
+//
+int
+mesh2d::collapse_short_edges()
+{
+   vector<short_edge> cand;
+   vector<cell2d*> touched;
+   cell2d_set::iterator itc;
+   node2d_list::iterator itn;
+   short_edge e;
+   cell2d *c;
+   face2d *f;
+   node2d *v;
+   unsigned dead, dropped;
+   int i, ia, ib, num, total = 0;
+
+   do
+   {
+      cand.clear();
+      touched.clear();
+      num = 0;
+      for( itc = mesh_cells.begin() ; itc != mesh_cells.end() ; itc++ )
+      {
+         c = *itc;
+         for( i = 0 ; i < 3 ; i++ )
+         {
+            f = c->face + i;
+            if( f->adj != 0 && f->adj->cell->id < c->id )
+               continue;
+            e.a = succ_node( f );
+            e.b = pred_node( f );
+            e.ratio = edge_ratio( e.a, e.b );
+            e.cell = c;
+            if( e.ratio < adapt_short )
+               cand.push_back( e );
+         }
+      }
+      if( cand.empty() )
+         break;
+      sort( cand.begin(), cand.end(), shorter_edge() );
+      //
+      // the removed cells and nodes are kept until the end of the pass and
+      // known by the dead and dropped stamps; the candidates are checked
+      // against the current cells
+      //
+      dead = next_epoch();
+      dropped = next_epoch();
+      for( i = 0 ; i < (int) cand.size() ; i++ )
+      {
+         e = cand[i];
+         if( e.cell->mark == dead )
+            continue;
+         ia = node_index( e.cell, e.a );
+         ib = node_index( e.cell, e.b );
+         if( ia < 0 || ib < 0 )
+            continue;
+         f = e.cell->face + ( 3 - ia - ib );
+         if( collapse_edge( f, e.a, e.b, dead, dropped, touched ) ||
+             collapse_edge( f, e.b, e.a, dead, dropped, touched ) )
+            num++;
+      }
+
+      cell2d_set flip;
+      for( i = 0 ; i < (int) touched.size() ; i++ )
+         if( touched[i]->mark != dead )
+            flip.insert( touched[i] );
+
+      for( itc = mesh_cells.begin() ; itc != mesh_cells.end() ; )
+      {
+         c = *itc;
+         if( c->mark == dead )
+         {
+            mesh_cells.erase( itc++ );
+            delete c;
+         }
+         else
+            itc++;
+      }
+      for( itn = mesh_nodes.begin() ; itn != mesh_nodes.end() ; )
+      {
+         v = *itn;
+         if( v->mark == dead )
+         {
+            itn = mesh_nodes.erase( itn );
+            delete v;
+         }
+         else if( v->mark == dropped )
+            itn = mesh_nodes.erase( itn );
+         else
+            itn++;
+      }
+      if( !flip.empty() )
+         make_delaunay( &flip );
+      total += num;
+   } while( num > 0 );
+   return total;
+}
+
+bool
+mesh2d::adapt( const double *size )
+{
+   typedef vector<int> id_list;
+
+   vector<id_list> regions;
+   vector<cell2d*> queue, star, cells;
+   cell2d_set::iterator itc;
+   node2d_list::iterator itn;
+   cell2d *c, *a;
+   face2d *f;
+   unsigned lng, seen;
+   int i, j, k, collapsed;
+
+   if( spill_chunk > 0 )
+   {
+      printf( "mesh2d::adapt: not available with the out of core storage.\n" );
+      return false;
+   }
+   if( !bad_cells.empty() || !fist_front.empty() )
+   {
+      printf( "mesh2d::adapt: the mesh generation is not finished.\n" );
+      return false;
+   }
+
+   for( itn = mesh_nodes.begin(), i = 0 ; itn != mesh_nodes.end() ; itn++, i++ )
+      (*itn)->h = size[i];
+
+   collapsed = collapse_short_edges();
+   clear_locate_grid();
+   if( adjacent_linked )
+   {
+      for( itn = mesh_nodes.begin() ; itn != mesh_nodes.end() ; itn++ )
+         (*itn)->head = 0;
+      for( itc = mesh_cells.begin() ; itc != mesh_cells.end() ; itc++ )
+         add_cell_to_nodes( *itc );
+   }
+   //
+   // the cells with a long inner edge and their neighbours are remeshed, the
+   // boundary edges are kept
+   //
+   lng = next_epoch();
+   for( itc = mesh_cells.begin() ; itc != mesh_cells.end() ; itc++ )
+   {
+      c = *itc;
+      for( i = 0 ; i < 3 ; i++ )
+      {
+         f = c->face + i;
+         if( f->adj != 0 && f->adj->cell->id > c->id &&
+             edge_ratio( succ_node( f ), pred_node( f ) ) > adapt_long )
+         {
+            queue.push_back( c );
+            queue.push_back( f->adj->cell );
+         }
+      }
+   }
+   for( i = 0, k = queue.size() ; i < k ; i++ )
+   {
+      c = queue[i];
+      c->mark = lng;
+      for( j = 0 ; j < 3 ; j++ )
+         if( c->face[j].adj != 0 )
+            c->face[j].adj->cell->mark = lng;
+   }
+   for( i = 0 ; i < k ; i++ )
+   {
+      c = queue[i];
+      for( j = 0 ; j < 3 ; j++ )
+         if( c->face[j].adj != 0 )
+            queue.push_back( c->face[j].adj->cell );
+   }
+   //
+   // Regions touching at a node are one region, a single call of
+   // remesh_region meshes one connected hole. The regions are kept by cell
+   // id, the cells of a region may go with the growth of an earlier one.
+   //
+   seen = next_epoch();
+   for( i = 0 ; i < (int) queue.size() ; i++ )
+   {
+      if( queue[i]->mark != lng )
+         continue;
+      queue[i]->mark = seen;
+      cells.assign( 1, queue[i] );
+      for( j = 0 ; j < (int) cells.size() ; j++ )
+      {
+         c = cells[j];
+         for( k = 0 ; k < 3 ; k++ )
+         {
+            node_star( c, c->face[k].node, star );
+            for( int m = 0 ; m < (int) star.size() ; m++ )
+            {
+               a = star[m];
+               if( a->mark == lng )
+               {
+                  a->mark = seen;
+                  cells.push_back( a );
+               }
+            }
+         }
+      }
+      regions.push_back( id_list() );
+      for( j = 0 ; j < (int) cells.size() ; j++ )
+         regions.back().push_back( cells[j]->id );
+   }
+   for( i = 0 ; i < (int) regions.size() ; i++ )
+   {
+      cells.clear();
+      for( j = 0 ; j < (int) regions[i].size() ; j++ )
+      {
+         cell2d key( regions[i][j] );
+         itc = mesh_cells.find( &key );
+         if( itc != mesh_cells.end() )
+            cells.push_back( *itc );
+      }
+      if( !cells.empty() && !remesh_region( cells, adapt_long ) )
+         return false;
+   }
+
+   printf( "Adaptation: %i edges collapsed, %i regions remeshed\n", collapsed, (int) regions.size() );
+   return true;
+}
+
+bool
+mesh2d::adapt_to_error( const double *error, double target, double order )
+{
+   cell2d_set::iterator itc;
+   node2d_list::iterator itn;
+   cell2d *c;
+   face2d *f;
+   node2d *u, *v;
+   double l, r;
+   int i;
+
+   if( target <= 0.0 || order <= 0.0 )
+   {
+      printf( "mesh2d::adapt_to_error: the target error and the order must be positive.\n" );
+      return false;
+   }
+   //
+   // the present size of a node is the mean length of its edges, each edge
+   // taken once from the cell owning its face
+   //
+   vector<double> size( mesh_nodes.size() );
+   vector<double> h0( mesh_nodes.size() );
+   for( itn = mesh_nodes.begin(), i = 0 ; itn != mesh_nodes.end() ; itn++, i++ )
+   {
+      h0[i] = (*itn)->h;
+      (*itn)->h = 0.0;
+      (*itn)->degree = 0.0;
+   }
+   for( itc = mesh_cells.begin() ; itc != mesh_cells.end() ; itc++ )
+   {
+      c = *itc;
+      for( i = 0 ; i < 3 ; i++ )
+      {
+         f = c->face + i;
+         if( f->adj != 0 && f->adj->cell->id < c->id )
+            continue;
+         u = succ_node( f );
+         v = pred_node( f );
+         l = norm( u->p.x - v->p.x, u->p.y - v->p.y );
+         u->h += l;
+         v->h += l;
+         u->degree += 1.0;
+         v->degree += 1.0;
+      }
+   }
+   //
+   // h ~ e^(1/order), the change is limited to a factor 4 per cycle
+   //
+   for( itn = mesh_nodes.begin(), i = 0 ; itn != mesh_nodes.end() ; itn++, i++ )
+   {
+      v = *itn;
+      l = ( v->degree > 0.0 ? v->h / v->degree : h0[i] );
+      r = ( error[i] > 0.0 ? pow( target / error[i], 1.0 / order ) : 4.0 );
+      size[i] = l * min( 4.0, max( 0.25, r ) );
+   }
+   return adapt( &size[0] );
+}
+
+//***EOF************************************************************************
@@ -82,6 +82,119 @@ circun_circle( double X0, double Y0, double X1, double Y1, double X2, double Y2,
 #endif
 }
 
+//
+// length of (x,y) in the metric m = { m11, m12, m22 }
+//
+inline double
+metric_norm( const double m[3], double x, double y )
+{
+   return sqrt( m[0]*x*x + 2.0*m[1]*x*y + m[2]*y*y );
+}
+
+//
+// metric length of the edge ab, with the mean metric of its ends
+//
+inline double
+metric_length( node2d *a, node2d *b )
+{
+   double m[3] = { 0.5 * ( a->m[0] + b->m[0] ), 0.5 * ( a->m[1] + b->m[1] ), 0.5 * ( a->m[2] + b->m[2] ) };
+   return metric_norm( m, b->p.x - a->p.x, b->p.y - a->p.y );
+}
+
+//
+// Metric of a cell, the mean of the metrics of its nodes. False when the
+// nodes carry none, the spacing is isotropic.
+//
+inline bool
+cell_metric( cell2d *c, double m[3] )
+{
+   node2d *n;
+   int i, k = 0;
+
+   m[0] = m[1] = m[2] = 0.0;
+   for( i = 0 ; i < 3 ; i++ )
+   {
+      n = c->face[i].node;
+      if( n->m[0] > 0.0 )
+      {
+         m[0] += n->m[0];
+         m[1] += n->m[1];
+         m[2] += n->m[2];
+         k++;
+      }
+   }
+   if( k == 0 )
+      return false;
+   m[0] /= k;
+   m[1] /= k;
+   m[2] /= k;
+   return true;
+}
+
+//
+// Circle through the three points in the metric m: the centre is at the
+// same metric distance rc of the points.
+//
+inline void
+metric_circle( const double m[3], double X0, double Y0, double X1, double Y1,
+               double X2, double Y2, double &xc, double &yc, double &rc )
+{
+   double d1x = X1 - X0, d1y = Y1 - Y0;
+   double d2x = X2 - X0, d2y = Y2 - Y0;
+
+   double g1x = m[0]*d1x + m[1]*d1y, g1y = m[1]*d1x + m[2]*d1y;
+   double g2x = m[0]*d2x + m[1]*d2y, g2y = m[1]*d2x + m[2]*d2y;
+
+   double r1 = 0.5 * ( d1x*g1x + d1y*g1y );
+   double r2 = 0.5 * ( d2x*g2x + d2y*g2y );
+   double dt = g1x*g2y - g1y*g2x;
+
+   double ux = ( r1*g2y - r2*g1y ) / dt;
+   double uy = ( r2*g1x - r1*g2x ) / dt;
+
+   xc = X0 + ux;
+   yc = Y0 + uy;
+   rc = metric_norm( m, ux, uy );
+}
+
+//
+// an edge by the ids of its nodes, the same in both directions
+//
+inline pair<int,int>
+edge_key( node2d *a, node2d *b )
+{
+   return( a->id < b->id ? make_pair( a->id, b->id ) : make_pair( b->id, a->id ) );
+}
+
+//
+// distance along the Hilbert curve through the 2^16 x 2^16 grid, close
+// keys are close points
+//
+inline unsigned
+hilbert_key( unsigned x, unsigned y )
+{
+   unsigned s, rx, ry, t, d = 0;
+
+   for( s = 1u << 15 ; s > 0 ; s >>= 1 )
+   {
+      rx = ( x & s ) != 0;
+      ry = ( y & s ) != 0;
+      d += s * s * ( ( 3 * rx ) ^ ry );
+      if( ry == 0 )
+      {
+         if( rx == 1 )
+         {
+            x = 65535 - x;
+            y = 65535 - y;
+         }
+         t = x;
+         x = y;
+         y = t;
+      }
+   }
+   return d;
+}
+
 inline int
 det( node2d *A, node2d *B, node2d* C )
 {
@@ -96,6 +209,27 @@ det( node2d *A, node2d *B, node2d* C )
       return isgn( dt );
 }
 
+//
+// det with a tolerance of angle_eps on the angle of AC with AB. The nodes
+// interpolated along a straight edge, and the rows advanced from them, are
+// aligned only within the rounding of their spacing, ~1E-10: far above
+// mesh_eps. Used by the FIST ear tests.
+//
+inline int
+rounded_det( node2d *A, node2d *B, node2d* C )
+{
+   double ux = B->p.x - A->p.x;
+   double uy = B->p.y - A->p.y;
+   double vx = C->p.x - A->p.x;
+   double vy = C->p.y - A->p.y;
+   double dt = ux * vy - uy * vx;
+
+   if( fabs( dt ) <= angle_eps * sqrt( ( ux * ux + uy * uy ) * ( vx * vx + vy * vy ) ) )
+      return 0;
+   else
+      return isgn( dt );
+}
+
 inline void
 circun_circle( cell2d *cl )
 {
@@ -108,7 +242,33 @@ circun_circle( cell2d *cl )
    double p2x = cl->face[2].node->p.x;
    double p2y = cl->face[2].node->p.y;
 
-   circun_circle( p0x, p0y, p1x, p1y, p2x, p2y, cl->xc, cl->yc, cl->rc );
+   double m[3];
+
+   if( cell_metric( cl, m ) )
+      metric_circle( m, p0x, p0y, p1x, p1y, p2x, p2y, cl->xc, cl->yc, cl->rc );
+   else
+      circun_circle( p0x, p0y, p1x, p1y, p2x, p2y, cl->xc, cl->yc, cl->rc );
+}
+
+//
+// distance of n to the circumcentre of c, in the metric of c if any
+//
+inline double
+circle_distance( cell2d *c, node2d *n )
+{
+   double m[3];
+
+   if( cell_metric( c, m ) )
+      return metric_norm( m, c->xc - n->p.x, c->yc - n->p.y );
+   else
+      return norm( c->xc - n->p.x, c->yc - n->p.y );
+}
+
+inline bool
+inside_circuncircle( cell2d *c, node2d *n )
+{
+   double r = circle_distance( c, n ) * ( 1.0 - 1E-8 );
+   return( r <= c->rc );
 }
 
 inline node2d*
@@ -152,6 +312,72 @@ cell_area( cell2d* c )
    return -0.5*( x_2*y_3 + x_1*y_2 + x_3*y_1 - y_1*x_2 - y_2*x_3 - y_3*x_1 );
 }
 
+//
+// shape quality: 1 for the equilateral triangle, 0 for a degenerate one
+//
+inline double
+cell_quality( cell2d* c )
+{
+   double l2 = 0.0;
+   int i;
+
+   for( i = 0 ; i < 3 ; i++ )
+      l2 += norm_sqr( succ_node( c->face+i )->p.x - pred_node( c->face+i )->p.x,
+                      succ_node( c->face+i )->p.y - pred_node( c->face+i )->p.y );
+
+   return( l2 > 0.0 ? 4.0 * sqrt( 3.0 ) * cell_area( c ) / l2 : 0.0 );
+}
+
+//
+// position of the node v in c, -1 if not a node of c
+//
+inline int
+node_index( cell2d *c, node2d *v )
+{
+   for( int i = 0 ; i < 3 ; i++ )
+      if( c->face[i].node == v )
+         return i;
+   return -1;
+}
+
+//
+// the cells around the node v of c0, true if they close around v
+//
+inline bool
+node_star( cell2d *c0, node2d *v, vector<cell2d*>& star )
+{
+   face2d *f;
+   cell2d *c;
+   int j, j0, entry;
+
+   star.clear();
+   star.push_back( c0 );
+   j0 = node_index( c0, v );
+
+   f = c0->face + succ[j0];
+   while( f->adj != 0 )
+   {
+      c = f->adj->cell;
+      if( c == c0 )
+         return true;
+      star.push_back( c );
+      entry = f->adj->id;
+      j = node_index( c, v );
+      f = c->face + ( succ[j] == entry ? pred[j] : succ[j] );
+   }
+
+   f = c0->face + pred[j0];
+   while( f->adj != 0 )
+   {
+      c = f->adj->cell;
+      star.push_back( c );
+      entry = f->adj->id;
+      j = node_index( c, v );
+      f = c->face + ( succ[j] == entry ? pred[j] : succ[j] );
+   }
+   return false;
+}
+
 inline bool
 segs_intersection( node2d *p0, node2d *p1, node2d *q0, node2d *q1 )
 {
@@ -0,0 +1,283 @@
+/***************************************************************************
+                            mesh generation code
+                            --------------------
+    self checks of the mesh generator, run by "make check"
+    copyright               : (C) 2001 by Joao Carlos de Campos Henriques
+    email                   : jcch@popsrv.ist.utl.pt
+ ***************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdarg.h>
+#include <string.h>
+#include <vector>
+
+#include "t_mesh2d.h"
+
+using namespace mesh_2d;
+
+static int checks = 0;
+static int failures = 0;
+
+//
+// the results go to stderr, the generator prints its progress on stdout
+//
+static void
+check( bool ok, const char *fmt, ... )
+{
+   va_list ap;
+
+   checks++;
+   if( !ok )
+      failures++;
+   fprintf( stderr, "%s ", ok ? "  ok  " : "  FAIL" );
+   va_start( ap, fmt );
+   vfprintf( stderr, fmt, ap );
+   va_end( ap );
+   fprintf( stderr, "\n" );
+}
+
+/***********************************************************************
+   fronts: the outer loops clockwise, the holes counter-clockwise
+ ***********************************************************************/
+
+static void
+add_circle( mesh2d& m, double xc, double yc, double r, int n, bool hole, int bc )
+{
+   vector<double> x( n ), y( n );
+   vector<int> bc_type( n, bc );
+   double t;
+   int i;
+
+   for( i = 0 ; i < n ; i++ )
+   {
+      t = 2.0 * M_PI * i / n;
+      x[i] = xc + r * cos( hole ? t : -t );
+      y[i] = yc + r * sin( hole ? t : -t );
+   }
+   m.add_front( n, &x[0], &y[0], &bc_type[0] );
+}
+
+//
+// rectangle [x0,x1]x[y0,y1] with nx and ny points per side
+//
+static void
+add_rectangle( mesh2d& m, double x0, double y0, double x1, double y1, int nx, int ny, int bc )
+{
+   vector<double> x, y;
+   vector<int> bc_type;
+   int i;
+
+   for( i = 0 ; i < ny ; i++ ) { x.push_back( x0 ); y.push_back( y0 + ( y1 - y0 ) * i / ny ); }
+   for( i = 0 ; i < nx ; i++ ) { x.push_back( x0 + ( x1 - x0 ) * i / nx ); y.push_back( y1 ); }
+   for( i = 0 ; i < ny ; i++ ) { x.push_back( x1 ); y.push_back( y1 - ( y1 - y0 ) * i / ny ); }
+   for( i = 0 ; i < nx ; i++ ) { x.push_back( x1 - ( x1 - x0 ) * i / nx ); y.push_back( y0 ); }
+   bc_type.assign( x.size(), bc );
+   m.add_front( x.size(), &x[0], &y[0], &bc_type[0] );
+}
+
+//
+// the boundary triangulation, which the generator keeps to itself
+//
+struct fist_mesh : public mesh2d
+{
+   cell2d_set& cells() { return bad_cells; }
+};
+
+/***********************************************************************
+   checks
+ ***********************************************************************/
+
+//
+// FIST on a cavity of the 20/10 annulus with -p 8: three nodes on each side
+// of the new node, above a row advanced from a cut. The row is straight
+// only within its offsets, multiples of its length; the offsets of the
+// annulus first, then bowed and zigzag rows. n - 2 cells, clockwise,
+// covering the cavity.
+//
+static void
+check_fist()
+{
+   static const double cavity[14][2] = {
+      { 11.314987726193577, 15.152606206422789 }, { 11.281976688869422, 15.026182155621727 },
+      { 11.360498584336773, 14.966904158609022 }, { 11.904711073661424, 12.694393732829603 },
+      { 0.0, 0.0 }, { 0.0, 0.0 }, { 0.0, 0.0 }, { 0.0, 0.0 }, { 0.0, 0.0 }, { 0.0, 0.0 },
+      { 11.367561338355456, 12.189976282883913 }, { 11.124007155180482, 15.143500684786847 },
+      { 11.235494125003468, 15.211643364704313 }, { 11.203145492268415, 15.085048202076218 } };
+   static const double annulus[8] = { 0.0, 2.41E-11, 2.9E-11, 3.81E-11, 4.87E-11, 5.8E-11, -5.94E-12, 0.0 };
+   static const double bow[] = { 5E-11, -5E-11, 2E-10 };
+   const int n = 14;
+   double x[n], y[n], area, sum, a, ex, ey, t;
+   int bc_type[n];
+   int b, i, neg;
+
+   for( b = 0 ; b < 7 ; b++ )
+   {
+      fist_mesh m;
+      cell2d_set::iterator it;
+      cell2d *c;
+
+      for( i = 0 ; i < n ; i++ )
+      {
+         x[i] = cavity[i][0];
+         y[i] = cavity[i][1];
+         bc_type[i] = 1;
+      }
+      ex = x[10] - x[3];
+      ey = y[10] - y[3];
+      for( i = 1 ; i < 7 ; i++ )
+      {
+         t = i / 7.0;
+         if( b == 0 )
+            a = annulus[i];
+         else if( b < 4 )
+            a = bow[ b - 1 ] * sin( M_PI * t );
+         else
+            a = bow[ b - 4 ] * ( i % 2 ? 1.0 : -1.0 );
+         x[3+i] = x[3] + t * ex - a * ey;
+         y[3+i] = y[3] + t * ey + a * ex;
+      }
+
+      area = 0.0;
+      for( i = 0 ; i < n ; i++ )
+         area += 0.5 * ( x[i] * y[ (i+1) % n ] - x[ (i+1) % n ] * y[i] );
+
+      m.set_dumping( false );
+      m.add_front( n, x, y, bc_type );
+      m.fist_generation();
+
+      sum = 0.0;
+      neg = 0;
+      for( it = m.cells().begin() ; it != m.cells().end() ; it++ )
+      {
+         c = *it;
+         a = cell_area( c );
+         sum += a;
+         neg += ( a <= 0.0 );
+      }
+      check( (int) m.cells().size() == n - 2 && neg == 0 && fabs( sum + area ) < 1E-9 * fabs( area ),
+             "fist, %s row %g: %i cells, %i not clockwise, area %g of %g",
+             b == 0 ? "annulus" : b < 4 ? "bowed" : "zigzag", b == 0 ? 0.0 : bow[ ( b - 1 ) % 3 ],
+             (int) m.cells().size(), neg, sum, -area );
+   }
+}
+
+//
+// estimate_mesh_size against the generated counts, within 30%
+//
+static void
+check_estimate()
+{
+   static const char *name[] = { "square", "square with a hole", "circle", "annulus" };
+   int k, nodes, cells, edges, est_nodes, est_cells, est_edges;
+
+   for( k = 0 ; k < 4 ; k++ )
+   {
+      mesh2d m;
+
+      m.set_dumping( false );
+      switch( k )
+      {
+      case 0: add_rectangle( m, 0.0, 0.0, 10.0, 10.0, 40, 40, 1 ); break;
+      case 1: add_rectangle( m, -10.0, -10.0, 10.0, 10.0, 8, 8, 1 );
+              add_circle( m, 0.0, 0.0, 0.5, 64, true, 2 ); break;
+      case 2: add_circle( m, 0.0, 0.0, 5.0, 80, false, 1 ); break;
+      case 3: add_circle( m, 0.0, 0.0, 2.0, 120, false, 1 );
+              add_circle( m, 0.0, 0.0, 1.0, 60, true, 2 ); break;
+      }
+      m.fist_generation();
+      m.estimate_mesh_size( &est_nodes, &est_cells, &est_edges );
+      m.mesh_generation();
+      m.get_mesh_properties( &nodes, &cells );
+      edges = cells + nodes - 1 + ( k == 1 || k == 3 ? 1 : 0 );
+
+      check( fabs( est_cells - cells ) <= 0.3 * cells,
+             "estimate, %s: %i cells expected, %i generated", name[k], est_cells, cells );
+      check( fabs( est_nodes - nodes ) <= 0.3 * nodes,
+             "estimate, %s: %i nodes expected, %i generated", name[k], est_nodes, nodes );
+      check( fabs( est_edges - edges ) <= 0.3 * edges,
+             "estimate, %s: %i edges expected, %i generated", name[k], est_edges, edges );
+   }
+}
+
+//
+// adapt on the square, half the spacing for x > 5 and twice for x < 5: the
+// right half gains cells and the left half loses them, also the nodes of
+// its boundary; the cells stay clockwise and cover the square
+//
+static void
+check_adapt()
+{
+   mesh2d m;
+   vector<double> size;
+   node2d *n;
+   cell2d *c;
+   double x, a, area, qmin;
+   int left[2], right[2], side[2], neg, k;
+
+   m.set_dumping( false );
+   add_rectangle( m, 0.0, 0.0, 10.0, 10.0, 40, 40, 1 );
+   m.fist_generation();
+   m.mesh_generation();
+
+   for( k = 0 ; k < 2 ; k++ )
+   {
+      if( k == 1 )
+      {
+         size.clear();
+         for( n = m.get_first_node() ; n != 0 ; n = m.get_next_node() )
+            size.push_back( n->h * ( n->p.x > 5.0 ? 0.5 : 2.0 ) );
+         m.adapt( &size[0] );
+      }
+      side[k] = 0;
+      for( n = m.get_first_node() ; n != 0 ; n = m.get_next_node() )
+         side[k] += ( n->p.x == 0.0 );
+      left[k] = right[k] = neg = 0;
+      area = 0.0;
+      qmin = 1.0;
+      for( c = m.get_first_cell() ; c != 0 ; c = m.get_next_cell() )
+      {
+         x = ( c->face[0].node->p.x + c->face[1].node->p.x + c->face[2].node->p.x ) / 3.0;
+         if( x > 5.0 )
+            right[k]++;
+         else
+            left[k]++;
+         a = cell_area( c );
+         area += a;
+         neg += ( a <= 0.0 );
+         qmin = min( qmin, cell_quality( c ) );
+      }
+   }
+
+   check( right[1] > 3.0 * right[0], "adapt, refined half: %i cells to %i", right[0], right[1] );
+   check( left[1] < 0.5 * left[0] && side[1] < 0.75 * side[0],
+          "adapt, coarsened half: %i cells to %i, %i nodes on its side to %i",
+          left[0], left[1], side[0], side[1] );
+   check( neg == 0 && fabs( area - 100.0 ) < 1E-9 * 100.0 && qmin > 0.2,
+          "adapt, %i not clockwise, area %g of 100, worst quality %g", neg, area, qmin );
+}
+
+int
+main( int argc, char *argv[] )
+{
+   struct { const char *name; void (*run)(); } all[] = {
+      { "estimate", check_estimate },
+      { "fist",     check_fist },
+      { "adapt",    check_adapt },
+   };
+   int i, j;
+
+   for( i = 0 ; i < (int)( sizeof(all) / sizeof(all[0]) ) ; i++ )
+   {
+      for( j = 1 ; j < argc && strcmp( argv[j], all[i].name ) != 0 ; j++ );
+      if( argc > 1 && j == argc )
+         continue;
+      all[i].run();
+   }
+
+   fprintf( stderr, "%i checks, %i failed\n", checks, failures );
+   return( failures != 0 );
+}
+//***EOF************************************************************************
@@ -0,0 +1,583 @@
+/***************************************************************************
+                            mesh generation code
+                            --------------------
+    coarsening of a generated mesh by edge collapse
+    copyright               : (C) 2001 by Joao Carlos de Campos Henriques
+    email                   : jcch@popsrv.ist.utl.pt
+ ***************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <algorithm>
+#include <map>
+
+#include "t_mesh2d.h"
+
+using namespace mesh_2d;
+
+//
+// the edges shorter than coarsen_short target spacings are collapsed, a new
+// edge may not be longer than coarsen_long and a collapse may not spoil the
+// cells below coarsen_quality, as in adapt
+//
+static const double coarsen_short   = 1.0;
+static const double coarsen_long    = 1.5;
+static const double coarsen_quality = 0.3;
+//
+// a boundary node is removed only where the boundary turns less than about
+// 20 degrees, the cosine of the angle between its two faces
+//
+static const double coarsen_turn    = 0.94;
+static const int    coarsen_passes  = 8;
+//
+// the flip sweeps after a pass, limited as in make_delaunay with a metric
+//
+static const int    coarsen_sweeps  = 16;
+//
+// partner of a node without periodic image, and of the nodes sharing a
+// bc_index with more than one other node, which are never removed
+//
+static const int no_partner = -1;
+static const int frozen     = -2;
+
+struct coarse_edge
+{
+   float    ratio;
+   int      a, b;
+};
+
+//
+// shortest first, the node indices break the ties
+//
+struct shorter_coarse_edge
+{
+   bool operator()( const coarse_edge& e1, const coarse_edge& e2 ) const
+   {
+      if( e1.ratio != e2.ratio )
+         return( e1.ratio < e2.ratio );
+      if( e1.a != e2.a )
+         return( e1.a < e2.a );
+      return( e1.b < e2.b );
+   }
+};
+
+//
+// The nodes and cells of mesh2d::coarsen by index: the node ids are their
+// positions in the node list and the cell index is num_cells - id, as in
+// export_arrays. Nothing is added while coarsening, the indices hold.
+//
+struct coarsen_state
+{
+   vector<node2d*>   nodes;
+   vector<cell2d*>   cells;
+   vector<cell2d*>   vcell;       // a cell of each node
+   vector<double>    hs;          // target spacing of each node
+   vector<int>       into;        // node a removed node went to
+   vector<int>       partner;     // periodic image, no_partner or frozen
+   vector<char>      alive;
+   vector<char>      boundary;    // on a face without neighbour, for good
+   vector<char>      unlinked;    // removed from the boundary, maybe in a front
+                                  // - block and not deleted
+   vector<char>      dead_cell;
+   vector<char>      changed;     // star changed in the pass, its edges retried
+   int               num_cells;
+
+   double ratio( node2d *a, node2d *b )
+   {
+      return( norm( a->p.x - b->p.x, a->p.y - b->p.y ) / ( 0.5 * ( hs[a->id] + hs[b->id] ) ) );
+   }
+   bool is_dead( cell2d *c ) { return dead_cell[ num_cells - c->id ] != 0; }
+};
+
+//
+// a collapse found by coarsen_test: b goes to a
+//
+struct coarse_collapse
+{
+   node2d           *a, *b;
+   bool              closed;      // b inside the mesh
+   vector<cell2d*>   sa, sb;      // stars of a and b
+};
+
+static inline node2d*
+third_node( cell2d *c, node2d *a, node2d *b )
+{
+   for( int i = 0 ; i < 3 ; i++ )
+      if( c->face[i].node != a && c->face[i].node != b )
+         return c->face[i].node;
+   return 0;
+}
+
+//
+// The collapse of b into a, with `ring` a fresh search stamp. The star of
+// b may be open only along the edge ab, where the boundary keeps its
+// bc_type and surface and nearly its shape, and a periodic b needs a
+// periodic a. As in mesh2d::collapse_edge, a and b may share only the
+// nodes facing the edge, no cell may fold or fall below the quality limit
+// and the new edges may not be long. A cell must be left around b.
+//
+static bool
+coarsen_test( coarsen_state& s, node2d *a, node2d *b, unsigned ring, coarse_collapse& cc )
+{
+   vector<cell2d*>& sa = cc.sa;
+   vector<cell2d*>& sb = cc.sb;
+   node2d *w, *o = 0, *opp[2];
+   cell2d *c;
+   face2d *fa, *fb;
+   double q_old = 1.0, q_new = 1.0, ar;
+   int i, j, k, ne = 0, nb = 0;
+
+   cc.a = a;
+   cc.b = b;
+   if( s.partner[ b->id ] == frozen || s.partner[ b->id ] == a->id ||
+       ( s.partner[ b->id ] >= 0 && s.partner[ a->id ] < 0 ) )
+      return false;
+   bool closed = cc.closed = node_star( s.vcell[ b->id ], b, sb );
+
+   for( i = 0 ; i < (int) sb.size() ; i++ )
+   {
+      c = sb[i];
+      q_old = min( q_old, cell_quality( c ) );
+      if( node_index( c, a ) >= 0 )
+      {
+         if( ne == 2 )
+            return false;
+         opp[ ne++ ] = third_node( c, a, b );
+      }
+      if( closed )
+         continue;
+      k = node_index( c, b );
+      for( j = 0 ; j < 3 ; j++ )
+      {
+         if( j == k || c->face[j].adj != 0 )
+            continue;
+         w = c->face[ 3 - j - k ].node;
+         if( w != a )
+            o = w;
+         nb++;
+      }
+   }
+   if( ne == 0 || ne == (int) sb.size() )
+      return false;
+
+   if( closed )
+   {
+      if( ne != 2 )
+         return false;
+   }
+   else
+   {
+      //
+      // along the boundary: b between a and o
+      //
+      if( ne != 1 || nb != 2 || o == 0 )
+         return false;
+      if( ( a->bc_type & o->bc_type ) != b->bc_type ||
+          a->bc_surface != b->bc_surface || o->bc_surface != b->bc_surface )
+         return false;
+      double ux = b->p.x - a->p.x, uy = b->p.y - a->p.y;
+      double vx = o->p.x - b->p.x, vy = o->p.y - b->p.y;
+      if( ux*vx + uy*vy < coarsen_turn * norm( ux, uy ) * norm( vx, vy ) )
+         return false;
+      if( s.partner[ b->id ] == no_partner &&
+          ( s.partner[ a->id ] != no_partner || s.partner[ o->id ] != no_partner ) )
+         return false;
+   }
+
+   for( i = 0 ; i < (int) sb.size() ; i++ )
+   {
+      c = sb[i];
+      k = node_index( c, b );
+      if( node_index( c, a ) >= 0 )
+      {
+         //
+         // a dying cell may not take the last cell of its third node
+         //
+         fa = c->face + node_index( c, a );
+         fb = c->face + k;
+         if( fa->adj == 0 && fb->adj == 0 )
+            return false;
+         continue;
+      }
+      for( j = 0 ; j < 3 ; j++ )
+         if( j != k && s.ratio( a, c->face[j].node ) > coarsen_long )
+            return false;
+      c->face[k].node = a;
+      ar = cell_area( c );
+      q_new = min( q_new, cell_quality( c ) );
+      c->face[k].node = b;
+      if( ar <= 0.0 )
+         return false;
+   }
+   if( q_new < min( q_old, coarsen_quality ) )
+      return false;
+   //
+   // the star of a last, most tests fail before
+   //
+   node_star( s.vcell[ a->id ], a, sa );
+   for( i = 0 ; i < (int) sa.size() ; i++ )
+      for( j = 0 ; j < 3 ; j++ )
+         sa[i]->face[j].node->mark = ring;
+
+   for( i = 0 ; i < (int) sb.size() ; i++ )
+   {
+      c = sb[i];
+      if( node_index( c, a ) >= 0 )
+         continue;
+      for( j = 0 ; j < 3 ; j++ )
+      {
+         w = c->face[j].node;
+         if( w != b && w->mark == ring && w != opp[0] && ( ne == 1 || w != opp[1] ) )
+            return false;
+      }
+   }
+   return true;
+}
+
+//
+// b goes to a, the two cells of the edge (one at the boundary) die
+//
+static int
+coarsen_apply( coarsen_state& s, coarse_collapse& cc, vector<cell2d*>& touched )
+{
+   node2d *a = cc.a, *b = cc.b, *w;
+   cell2d *c;
+   face2d *fa, *fb;
+   int i, k, dying = 0;
+
+   for( i = 0 ; i < (int) cc.sb.size() ; i++ )
+   {
+      c = cc.sb[i];
+      k = node_index( c, b );
+      if( node_index( c, a ) >= 0 )
+      {
+         fa = c->face + node_index( c, a );
+         fb = c->face + k;
+         w = third_node( c, a, b );
+         s.vcell[ w->id ] = ( fa->adj ? fa->adj->cell : fb->adj->cell );
+         s.changed[ w->id ] = 1;
+         if( fa->adj != 0 ) fa->adj->adj = fb->adj;
+         if( fb->adj != 0 ) fb->adj->adj = fa->adj;
+         s.dead_cell[ s.num_cells - c->id ] = 1;
+         dying++;
+      }
+      else
+      {
+         c->face[k].node = a;
+         circun_circle( c );
+         touched.push_back( c );
+         s.vcell[ a->id ] = c;
+      }
+   }
+   s.alive[ b->id ] = 0;
+   s.unlinked[ b->id ] = !cc.closed;
+   s.into[ b->id ] = a->id;
+   return dying;
+}
+
+//
+// the removable node first: inside, on the boundary, periodic
+//
+static inline int
+coarsen_rank( coarsen_state& s, node2d *v )
+{
+   if( s.partner[ v->id ] != no_partner )
+      return 2;
+   return s.boundary[ v->id ];
+}
+
+bool
+mesh2d::coarsen( double ratio, vector<int> *node_map )
+{
+   coarsen_state s;
+   coarse_collapse c1, c2;
+   vector<coarse_edge> edges;
+   vector<cell2d*> touched, flip;
+   vector<int> count;
+   map<int, vector<int> > periodic;
+   map<int, vector<int> >::iterator itp;
+   node2d_list::iterator itn;
+   cell2d_set::iterator itc;
+   coarse_edge e;
+   cell2d *c;
+   face2d *f;
+   node2d *a, *b, *v;
+   unsigned mark;
+   bool flipped;
+   double len, scale;
+   int num_nodes, num_cells, target, pass, collapsed, total, i, j, k, m, l;
+
+   if( spill_chunk > 0 )
+   {
+      printf( "mesh2d::coarsen: not available with the out of core storage.\n" );
+      return false;
+   }
+   if( !bad_cells.empty() || !fist_front.empty() )
+   {
+      printf( "mesh2d::coarsen: the mesh generation is not finished.\n" );
+      return false;
+   }
+   if( ratio <= 0.0 || ratio >= 1.0 )
+   {
+      printf( "mesh2d::coarsen: the ratio must be between 0 and 1.\n" );
+      return false;
+   }
+
+   num_cells = mesh_cells.size();
+   s.num_cells = num_cells;
+   s.cells.reserve( num_cells );
+   for( itc = mesh_cells.begin(), i = num_cells ; itc != mesh_cells.end() ; itc++ )
+   {
+      (*itc)->id = i--;
+      s.cells.push_back( *itc );
+   }
+   for( itn = mesh_nodes.begin(), i = 0 ; itn != mesh_nodes.end() ; itn++ )
+   {
+      (*itn)->id = i++;
+      s.nodes.push_back( *itn );
+   }
+   num_nodes = s.nodes.size();
+   s.vcell.assign( num_nodes, 0 );
+   s.hs.assign( num_nodes, 0.0 );
+   s.into.resize( num_nodes );
+   s.partner.assign( num_nodes, no_partner );
+   s.alive.assign( num_nodes, 1 );
+   s.unlinked.assign( num_nodes, 0 );
+   s.boundary.assign( num_nodes, 0 );
+   s.dead_cell.assign( num_cells, 0 );
+   s.changed.assign( num_nodes, 1 );
+   count.assign( num_nodes, 0 );
+   //
+   // the target spacing is the mean length of the edges of a node over the
+   // square root of the ratio
+   //
+   for( i = 0 ; i < num_cells ; i++ )
+   {
+      c = s.cells[i];
+      for( k = 0 ; k < 3 ; k++ )
+      {
+         f = c->face + k;
+         if( f->adj != 0 && f->adj->cell->id > c->id )
+            continue;
+         a = succ_node( f );
+         b = pred_node( f );
+         len = norm( a->p.x - b->p.x, a->p.y - b->p.y );
+         if( f->adj == 0 )
+            s.boundary[ a->id ] = s.boundary[ b->id ] = 1;
+         s.hs[ a->id ] += len;
+         s.hs[ b->id ] += len;
+         count[ a->id ]++;
+         count[ b->id ]++;
+      }
+   }
+   scale = 1.0 / sqrt( ratio );
+   for( i = 0 ; i < num_nodes ; i++ )
+   {
+      s.into[i] = i;
+      if( count[i] > 0 )
+         s.hs[i] *= scale / count[i];
+      if( s.nodes[i]->bc_index != 0 )
+         periodic[ s.nodes[i]->bc_index ].push_back( i );
+   }
+   //
+   // the boundary nodes sharing a bc_index are periodic images, removed
+   // together
+   //
+   for( itp = periodic.begin() ; itp != periodic.end() ; itp++ )
+   {
+      vector<int>& p = itp->second;
+      if( p.size() == 2 )
+      {
+         s.partner[ p[0] ] = p[1];
+         s.partner[ p[1] ] = p[0];
+      }
+      else
+         for( j = 0 ; j < (int) p.size() ; j++ )
+            s.partner[ p[j] ] = frozen;
+   }
+
+   target = (int) ( ratio * num_cells );
+   total = num_cells;
+   for( pass = 0 ; pass < coarsen_passes && total > target ; pass++ )
+   {
+      for( i = 0 ; i < num_cells ; i++ )
+         if( !s.dead_cell[i] )
+            for( k = 0 ; k < 3 ; k++ )
+               s.vcell[ s.cells[i]->face[k].node->id ] = s.cells[i];
+      //
+      // the short edges, shortest first. The edges of a node change with
+      // its collapses, they are measured again when their turn comes and
+      // the new edges wait for the next pass. An edge that failed is tried
+      // again only when the star of one of its nodes changed
+      //
+      edges.clear();
+      for( i = 0 ; i < num_cells ; i++ )
+      {
+         if( s.dead_cell[i] )
+            continue;
+         c = s.cells[i];
+         for( k = 0 ; k < 3 ; k++ )
+         {
+            f = c->face + k;
+            if( f->adj != 0 && f->adj->cell->id > c->id )
+               continue;
+            a = succ_node( f );
+            b = pred_node( f );
+            if( !s.changed[ a->id ] && !s.changed[ b->id ] )
+               continue;
+            e.ratio = s.ratio( a, b );
+            if( e.ratio >= coarsen_short )
+               continue;
+            e.a = a->id;
+            e.b = b->id;
+            edges.push_back( e );
+         }
+      }
+      sort( edges.begin(), edges.end(), shorter_coarse_edge() );
+      s.changed.assign( num_nodes, 0 );
+
+      collapsed = 0;
+      touched.clear();
+      for( l = 0 ; l < (int) edges.size() && total > target ; l++ )
+      {
+         e = edges[ l ];
+         if( !s.alive[ e.a ] || !s.alive[ e.b ] )
+            continue;
+         a = s.nodes[ e.a ];
+         b = s.nodes[ e.b ];
+         if( s.ratio( a, b ) >= coarsen_short )
+            continue;
+         //
+         // b is the node to remove first
+         //
+         if( coarsen_rank( s, a ) < coarsen_rank( s, b ) )
+            swap( a, b );
+
+         for( m = 0 ; m < 2 ; m++, swap( a, b ) )
+         {
+            if( !coarsen_test( s, a, b, next_epoch(), c1 ) )
+               continue;
+            if( s.partner[ b->id ] >= 0 )
+            {
+               node2d *pa = s.nodes[ s.partner[ a->id ] ];
+               node2d *pb = s.nodes[ s.partner[ b->id ] ];
+               if( !s.alive[ pa->id ] || !s.alive[ pb->id ] ||
+                   !coarsen_test( s, pa, pb, next_epoch(), c2 ) )
+                  continue;
+               //
+               // the two collapses may not share a node
+               //
+               mark = next_epoch();
+               for( i = 0 ; i < (int) c1.sa.size() ; i++ )
+                  for( j = 0 ; j < 3 ; j++ )
+                     c1.sa[i]->face[j].node->mark = mark;
+               for( i = 0 ; i < (int) c1.sb.size() ; i++ )
+                  for( j = 0 ; j < 3 ; j++ )
+                     c1.sb[i]->face[j].node->mark = mark;
+               bool apart = true;
+               for( i = 0 ; i < (int) c2.sa.size() && apart ; i++ )
+                  for( j = 0 ; j < 3 ; j++ )
+                     apart &= ( c2.sa[i]->face[j].node->mark != mark );
+               for( i = 0 ; i < (int) c2.sb.size() && apart ; i++ )
+                  for( j = 0 ; j < 3 ; j++ )
+                     apart &= ( c2.sb[i]->face[j].node->mark != mark );
+               if( !apart )
+                  continue;
+               total -= coarsen_apply( s, c1, touched );
+               total -= coarsen_apply( s, c2, touched );
+               collapsed += 2;
+            }
+            else
+            {
+               total -= coarsen_apply( s, c1, touched );
+               collapsed++;
+            }
+            break;
+         }
+      }
+      //
+      // the cells around the collapses are flipped to Delaunay, as
+      // make_delaunay does without building a cell set
+      //
+      mark = next_epoch();
+      flip.clear();
+      for( i = 0 ; i < (int) touched.size() ; i++ )
+      {
+         c = touched[i];
+         if( s.is_dead( c ) || c->mark == mark )
+            continue;
+         c->mark = mark;
+         flip.push_back( c );
+      }
+      flipped = true;
+      for( m = 0 ; flipped && ( metric_func == 0 || m < coarsen_sweeps ) ; m++ )
+      {
+         flipped = false;
+         for( i = 0 ; i < (int) flip.size() ; i++ )
+            for( k = 0 ; k < 3 ; k++ )
+               flipped |= green_sibson( flip[i]->face + k );
+      }
+      for( i = 0 ; i < (int) flip.size() ; i++ )
+         for( k = 0 ; k < 3 ; k++ )
+            s.changed[ flip[i]->face[k].node->id ] = 1;
+
+      printf( "Coarsening pass %i: %i nodes removed, %i cells\n", pass + 1, collapsed, total );
+      if( collapsed == 0 )
+         break;
+   }
+   //
+   // the cells and nodes left, in the same order
+   //
+   mesh_cells.clear();
+   for( i = 0 ; i < num_cells ; i++ )
+   {
+      if( s.dead_cell[i] )
+         delete s.cells[i];
+      else
+         mesh_cells.insert( mesh_cells.end(), s.cells[i] );
+   }
+   for( i = 0 ; i < num_nodes ; i++ )
+   {
+      j = i;
+      while( !s.alive[j] )
+         j = s.into[j];
+      s.into[i] = j;
+   }
+   for( itn = mesh_nodes.begin(), k = 0 ; itn != mesh_nodes.end() ; )
+   {
+      v = *itn;
+      if( s.alive[ v->id ] )
+      {
+         count[ v->id ] = k++;
+         itn++;
+      }
+      else
+         itn = mesh_nodes.erase( itn );
+   }
+   if( node_map )
+   {
+      node_map->resize( num_nodes );
+      for( i = 0 ; i < num_nodes ; i++ )
+         (*node_map)[i] = count[ s.into[i] ];
+   }
+   for( i = 0 ; i < num_nodes ; i++ )
+      if( !s.alive[i] && !s.unlinked[i] )
+         delete s.nodes[i];
+
+   clear_locate_grid();
+   if( adjacent_linked )
+   {
+      for( itn = mesh_nodes.begin() ; itn != mesh_nodes.end() ; itn++ )
+         (*itn)->head = 0;
+      for( itc = mesh_cells.begin() ; itc != mesh_cells.end() ; itc++ )
+         add_cell_to_nodes( *itc );
+   }
+
+   printf( "Coarsening: %i cells, %i nodes to %i cells, %i nodes\n", num_cells, num_nodes,
+           (int) mesh_cells.size(), (int) mesh_nodes.size() );
+   return true;
+}
+
+//***EOF************************************************************************
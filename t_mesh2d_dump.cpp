@@ -297,7 +297,7 @@ mesh2d::is_delaunay()
          if( f != 0 )
          {
             n = f->node;
-            s  = norm( n->p.x - c->xc, n->p.y - c->yc );
+            s  = circle_distance( c, n );
             if( s <= c->rc * ( 1.0 + 1E-8 ) )
                cnt++;
          }
@@ -317,10 +317,14 @@ mesh2d::green_sibson( face2d *f1 )
    face2d *tf1[3];
    face2d *tf2[3];
 
+   edge2d *te1[3];
+   edge2d *te2[3];
+
    cell2d *c1, *c2;
    face2d *f2;
    node2d *n2;
-   double s, a, b;
+   double s, a, b, r, m[3], xc, yc;
+   bool metric;
    int i;
 
    if( f1->adj != 0 )
@@ -329,9 +333,27 @@ mesh2d::green_sibson( face2d *f1 )
       f2 = f1->adj;
       n2 = f2->node;
 
-      s  = norm( c1->xc - n2->p.x, c1->yc - n2->p.y );
+      metric = cell_metric( c1, m );
+      if( metric )
+      {
+         //
+         // both diagonals are tested in the mean metric of the four
+         // nodes, otherwise the flip may be undone by the other cell
+         //
+         for( i = 0 ; i < 3 ; i++ )
+            m[i] = 0.25 * ( 3.0 * m[i] + n2->m[i] );
+         metric_circle( m, c1->face[0].node->p.x, c1->face[0].node->p.y,
+                           c1->face[1].node->p.x, c1->face[1].node->p.y,
+                           c1->face[2].node->p.x, c1->face[2].node->p.y, xc, yc, r );
+         s = metric_norm( m, xc - n2->p.x, yc - n2->p.y );
+      }
+      else
+      {
+         s = norm( c1->xc - n2->p.x, c1->yc - n2->p.y );
+         r = c1->rc;
+      }
 
-      if( s <= c1->rc * ( 1.0 - 1E-8 ) )
+      if( s <= r * ( 1.0 - 1E-8 ) )
       {
          // non-Delaunay
          c2 = f2->cell;
@@ -357,6 +379,14 @@ mesh2d::green_sibson( face2d *f1 )
          tf2[0] = c1->face+0;
          tf2[1] = pred_face( f2 )->adj;
          tf2[2] = succ_face( f1 )->adj;
+         //
+         // the frontal edges follow their faces
+         //
+         te1[0] = te2[0] = 0;
+         te1[1] = pred_face( f1 )->edge;
+         te1[2] = succ_face( f2 )->edge;
+         te2[1] = pred_face( f2 )->edge;
+         te2[2] = succ_face( f1 )->edge;
 
          for( i = 0 ; i < 3 ; i++ )
          {
@@ -365,9 +395,20 @@ mesh2d::green_sibson( face2d *f1 )
 
             attach_faces( c1->face+i, tf1[i] );
             attach_faces( c2->face+i, tf2[i] );
+
+            c1->face[i].edge = te1[i];
+            c2->face[i].edge = te2[i];
+            if( te1[i] != 0 ) te1[i]->adj = c1->face+i;
+            if( te2[i] != 0 ) te2[i]->adj = c2->face+i;
          }
          circun_circle( c1 );
          circun_circle( c2 );
+         //
+         // the metric changes from cell to cell, the flips may cycle: the
+         // neighbours are left to the next sweep of make_delaunay
+         //
+         if( metric )
+            return true;
          if( tf1[2] )
             green_sibson( tf1[2] );
          if( tf2[1] )
@@ -380,6 +421,11 @@ mesh2d::green_sibson( face2d *f1 )
    return false;
 }
 
+//
+// with a metric the flips are not sure to end, the sweeps are limited
+//
+static const int metric_sweeps = 16;
+
 bool
 mesh2d::make_delaunay( cell2d_set* s )
 {
@@ -391,7 +437,7 @@ mesh2d::make_delaunay( cell2d_set* s )
    if( s->empty() )
       THROW__X( "mesh2d::make_delaunay called with empty set.\n" );
 
-   while( changed )
+   while( changed && ( metric_func == 0 || cnt < metric_sweeps ) )
    {
       changed = false;
 
@@ -25,6 +25,16 @@ fist2d::fist2d( node2d* (*ndalloc)(int), cell2d* (*clalloc)(int),
    begin_front();
 }
 
+fist2d::~fist2d()
+{
+   unsigned i;
+
+   for( i = 0 ; i < node_blocks.size() ; i++ )
+      delete[] node_blocks[i];
+   for( i = 0 ; i < link_blocks.size() ; i++ )
+      delete[] link_blocks[i];
+}
+
 void
 fist2d::add_length( link2d *l )
 {
@@ -87,6 +97,80 @@ fist2d::end_front()
    add_length( front.local_prev );
 }
 
+//
+// Adds a whole closed front (without the repeated first point) in one go.
+// With the default allocators nodes and links are taken from one block each,
+// the spacing is evaluated on the coordinate arrays and the links are
+// appended to fist_front in key order. Ids and h are the same as with
+// begin_front/add_to_front/end_front.
+//
+void
+fist2d::add_front( int n, const double *x, const double *y, const int *bc_type,
+                   const int *bc_index, const int *bc_surface, const double *param )
+{
+   node2d *nd, *nblk = 0;
+   link2d *lk, *lblk = 0;
+   int i;
+
+   if( n < 3 )
+      THROW__X( "fist2d::add_front: a front needs at least three points." );
+
+   vector<double> len( n );
+   for( i = 0 ; i < n - 1 ; i++ )
+      len[i] = 0.5 * norm( x[i] - x[i+1], y[i] - y[i+1] );
+   len[n-1] = 0.5 * norm( x[n-1] - x[0], y[n-1] - y[0] );
+
+   if( node_alloc == def_node_alloc && link_alloc == def_link_alloc )
+   {
+      nblk = new node2d[n];
+      lblk = new link2d[n];
+      node_blocks.push_back( nblk );
+      link_blocks.push_back( lblk );
+   }
+
+   begin_front();
+   for( i = 0 ; i < n ; i++ )
+   {
+      nd = ( nblk ? nblk + i : node_alloc( 0 ) );
+      nd->id  = ++cur_node_id;
+      nd->p.x = x[i];
+      nd->p.y = y[i];
+      nd->h   = len[ i == 0 ? n - 1 : i - 1 ] + len[i];
+
+      nd->param      = ( param ? param[i] : 0.0 );
+      nd->bc_type    = bc_type[i];
+      nd->bc_index   = ( bc_index ? bc_index[i] : 0 );
+      nd->bc_surface = ( bc_surface ? bc_surface[i] : 0 );
+      mesh_nodes.push_back( nd );
+
+      if( lblk )
+      {
+         lk = lblk + i;
+         lk->id = ++cur_link_id;
+      }
+      else
+         lk = link_alloc( ++cur_link_id );
+      lk->node = nd;
+      lk->adj  = 0;
+      lk->prev = front.local_prev;
+      if( front.local_prev != 0 )
+         front.local_prev->next = lk;
+      else
+         front.local_first = lk;
+      front.local_prev = lk;
+   }
+   front.local_first->prev = front.local_prev;
+   front.local_prev->next  = front.local_first;
+
+   //
+   // node ids grow along the front, the keys come in increasing order
+   //
+   for( lk = front.local_first, i = 0 ; i < n ; lk = lk->next, i++ )
+      fist_front.insert( fist_front.end(), lk );
+
+   begin_front();
+}
+
 /***********************************************************************
    FIST code
  ***********************************************************************/
@@ -106,8 +190,11 @@ fist2d::classify_store_link( link2d *cl )
    x = ax * bx + ay * by;
 
    cl->angle = atan2pi( y, x );
-
-   if( cl->angle < M_PI )
+   //
+   // a link straight within angle_eps is reflex: never an ear, and tested
+   // against the ears it lies on
+   //
+   if( y > 0.0 && ( x > 0.0 || y > angle_eps * sqrt( ( ax * ax + ay * ay ) * ( bx * bx + by * by ) ) ) )
       convex.insert( cl );
    else
       reflex.insert( cl );
@@ -141,9 +228,9 @@ fist2d::reflex_nodes_in_cell( link2d *vim1, link2d *vi, link2d *vip1 )
 
       if( vi->node != cl->node && vim1->node != cl->node && vip1->node != cl->node )
       {
-         a = det( vi->node, vip1->node, cl->node );
-         b = det( vip1->node, vim1->node, cl->node );
-         c = det( vim1->node, vi->node, cl->node );
+         a = rounded_det( vi->node, vip1->node, cl->node );
+         b = rounded_det( vip1->node, vim1->node, cl->node );
+         c = rounded_det( vim1->node, vi->node, cl->node );
 
          if( a <= 0 && b <= 0 && c <= 0 )
             return true;
@@ -205,6 +292,30 @@ fist2d::attach_faces( face2d *fa, face2d *fb )
    if( fb != 0 ) fb->adj = fa;
 }
 
+void
+fist2d::insert_bad_cell( cell2d *c )
+{
+   bad_cells.insert( c );
+   c->slot = bad_array.size();
+   bad_array.push_back( c );
+}
+
+void
+fist2d::erase_bad_cell( cell2d *c )
+{
+   cell2d *last;
+
+   bad_cells.erase( c );
+   if( c->slot < 0 )
+      return;
+
+   last = bad_array.back();
+   bad_array[ c->slot ] = last;
+   last->slot = c->slot;
+   bad_array.pop_back();
+   c->slot = -1;
+}
+
 void
 fist2d::create_cell( link2d *vi, link2d *vip1, link2d *vim1 )
 {
@@ -214,8 +325,12 @@ fist2d::create_cell( link2d *vi, link2d *vip1, link2d *vim1 )
    c->face[1].node = vip1->node;
    c->face[2].node = vim1->node;
 
+   c->face[0].edge = ( vip1->next == vim1 ? vip1->edge : 0 );
+   c->face[1].edge = vim1->edge;
+   c->face[2].edge = vi->edge;
+
    circun_circle( c );
-   bad_cells.insert( c );
+   insert_bad_cell( c );
 
    attach_bad_edges( c );  // used only in internal mesh generation
 
@@ -238,6 +353,7 @@ fist2d::create_cell( link2d *vi, link2d *vip1, link2d *vim1 )
    classify_store_link( vim1 );
 
    vim1->adj = c->face+0;
+   vim1->edge = 0;
 }
 
 bool
@@ -272,9 +388,9 @@ fist2d::join_fronts()
       nl1 = lt->node;
       if( ni != nl1 && nip1 != nl1 && nim1 != nl1 )
       {
-         a = det( ni,   nip1, nl1 );
-         b = det( nip1, nim1, nl1 );
-         c = det( nim1, ni,   nl1 );
+         a = rounded_det( ni,   nip1, nl1 );
+         b = rounded_det( nip1, nim1, nl1 );
+         c = rounded_det( nim1, ni,   nl1 );
 
          if( a <= 0 && b <= 0 && c <= 0 )
             neighbours.insert( lt );
@@ -306,9 +422,9 @@ fist2d::join_fronts()
             //
             // test point inside
             //
-            a = det( ni,   nip1, nl1 );
-            b = det( nip1, ncl,  nl1 );
-            c = det( ncl,  ni,   nl1 );
+            a = rounded_det( ni,   nip1, nl1 );
+            b = rounded_det( nip1, ncl,  nl1 );
+            c = rounded_det( ncl,  ni,   nl1 );
             if( a <= 0 && b <= 0 && c <= 0 )
                break;   // found an invalid triangle
             //
@@ -335,9 +451,10 @@ fist2d::join_fronts()
          cn->face[0].node = ni;
          cn->face[1].node = nip1;
          cn->face[2].node = ncl;
+         cn->face[2].edge = vi->edge;
 
          circun_circle( cn );
-         bad_cells.insert( cn );
+         insert_bad_cell( cn );
          attach_bad_edges( cn );
 
          erase_link_from_sets( vi );      // the link angles have changed
@@ -358,6 +475,7 @@ fist2d::join_fronts()
          cl->prev = vi;
          vi->next = cl;
          vi->adj  = cn->face+1;
+         vi->edge = 0;
 
          classify_store_link( vi );
          classify_store_link( cl );
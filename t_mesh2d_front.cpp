@@ -0,0 +1,394 @@
+/***************************************************************************
+                            mesh generation code
+                            --------------------
+    front input: text and binary front files
+    copyright               : (C) 2001 by Joao Carlos de Campos Henriques
+    email                   : jcch@popsrv.ist.utl.pt
+ ***************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <charconv>
+#include <ctype.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "t_mesh2d_front.h"
+
+namespace mesh_2d
+{
+   const char front_magic[8] = { 'F','I','S','T','2','D','F','\0' };
+   const int  front_version  = 1;
+   const int  front_bom      = 0x01020304;
+   const int  front_record   = 2 * sizeof(double) + 3 * sizeof(int);
+}
+
+using namespace mesh_2d;
+
+/***********************************************************************
+   read only memory mapped file
+ ***********************************************************************/
+
+class mapped_file
+{
+public:
+   const char *data;
+   size_t      size;
+
+   bool open( const char *filename );
+
+   mapped_file() { data = 0; size = 0; }
+   ~mapped_file() { if( size ) munmap( (void*) data, size ); }
+};
+
+bool
+mapped_file::open( const char *filename )
+{
+   struct stat st;
+   int fd;
+
+   fd = ::open( filename, O_RDONLY );
+   if( fd < 0 )
+   {
+      fprintf( stderr, "%s: unable to open the front file\n", filename );
+      return false;
+   }
+   if( fstat( fd, &st ) != 0 )
+   {
+      fprintf( stderr, "%s: unable to stat the front file\n", filename );
+      close( fd );
+      return false;
+   }
+   if( st.st_size > 0 )
+   {
+      void *p = mmap( 0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+      if( p == MAP_FAILED )
+      {
+         fprintf( stderr, "%s: unable to map the front file\n", filename );
+         close( fd );
+         return false;
+      }
+      madvise( p, st.st_size, MADV_SEQUENTIAL );
+      data = (const char*) p;
+      size = st.st_size;
+   }
+   close( fd );
+   return true;
+}
+
+/***********************************************************************
+   text front
+ ***********************************************************************/
+
+class front_parser
+{
+   const char *filename;
+   const char *cur;
+   const char *end;
+   const char *line_start;
+   int         line;
+
+   void skip_space()
+   {
+      while( cur != end && ( *cur == ' ' || *cur == '\t' || *cur == '\r' || *cur == '\n' ) )
+      {
+         if( *cur == '\n' )
+         {
+            line++;
+            line_start = cur + 1;
+         }
+         cur++;
+      }
+   }
+
+public:
+   void error( const char *msg )
+   {
+      fprintf( stderr, "%s:%i:%i: %s\n", filename, line, (int)( cur - line_start ) + 1, msg );
+   }
+
+   template<class T>
+   bool read( T &a, const char *what )
+   {
+      skip_space();
+      if( cur == end )
+      {
+         error( "unexpected end of file" );
+         return false;
+      }
+      const char *first = cur;
+      if( *first == '+' && first + 1 != end && ( isdigit( (unsigned char) first[1] ) || first[1] == '.' ) )
+         first++;                                 // from_chars rejects the plus sign
+      std::from_chars_result r = std::from_chars( first, end, a );
+      if( r.ec != std::errc() || ( r.ptr != end && !isspace( (unsigned char) *r.ptr ) ) )
+      {
+         error( what );
+         return false;
+      }
+      cur = r.ptr;
+      return true;
+   }
+
+   bool at_end()
+   {
+      skip_space();
+      return( cur == end );
+   }
+   //
+   // bytes left after the blanks
+   //
+   size_t left()
+   {
+      skip_space();
+      return( end - cur );
+   }
+
+   front_parser( const char *f, const char *b, size_t s )
+   {
+      filename = f;
+      cur = line_start = b;
+      end = b + s;
+      line = 1;
+   }
+};
+
+bool
+mesh_2d::read_front_text( const char *filename, front_list& fronts )
+{
+   mapped_file mf;
+   int n_frts, n_pts, f, j;
+
+   if( !mf.open( filename ) )
+      return false;
+
+   front_parser ps( filename, mf.data, mf.size );
+
+   if( !ps.read( n_frts, "expected the number of fronts" ) )
+      return false;
+   if( n_frts <= 0 )
+   {
+      ps.error( "the number of fronts must be positive" );
+      return false;
+   }
+   //
+   // the fronts grow as they are read and a count is checked against the
+   // bytes left, at least 6 per point ("0 0 0\n"), before the allocation:
+   // a corrupt count gives an error, not bad_alloc
+   //
+   fronts.clear();
+
+   for( f = 0 ; f < n_frts ; f++ )
+   {
+      if( !ps.read( n_pts, "expected the number of front points" ) )
+         return false;
+      if( n_pts < 3 )
+      {
+         ps.error( "a front needs at least three points" );
+         return false;
+      }
+      if( (size_t) n_pts > ( ps.left() + 1 ) / 6 )
+      {
+         ps.error( "more front points than the file holds" );
+         return false;
+      }
+
+      fronts.push_back( front_points() );
+      front_points& fp = fronts.back();
+      fp.resize( n_pts );
+      for( j = 0 ; j < n_pts ; j++ )
+      {
+         if( !ps.read( fp.x[j], "expected the x coordinate" ) ||
+             !ps.read( fp.y[j], "expected the y coordinate" ) ||
+             !ps.read( fp.bc_type[j], "expected an integer bc_type" ) )
+            return false;
+         fp.bc_index[j] = fp.bc_surface[j] = 0;
+      }
+      //
+      // closed front: drop the repeated first point
+      //
+      if( fp.x[n_pts-1] == fp.x[0] && fp.y[n_pts-1] == fp.y[0] )
+         fp.resize( n_pts - 1 );
+      if( fp.size() < 3 )
+      {
+         ps.error( "a closed front needs at least three distinct points" );
+         return false;
+      }
+   }
+
+   if( !ps.at_end() )
+   {
+      ps.error( "unexpected data after the last front" );
+      return false;
+   }
+   return true;
+}
+
+/***********************************************************************
+   binary front
+ ***********************************************************************/
+
+bool
+mesh_2d::is_front_binary( const char *filename )
+{
+   char magic[ sizeof(front_magic) ];
+   FILE *stream = fopen( filename, "rb" );
+   bool ok;
+
+   if( stream == 0 )
+      return false;
+   ok = ( fread( magic, sizeof(magic), 1, stream ) == 1 &&
+          memcmp( magic, front_magic, sizeof(magic) ) == 0 );
+   fclose( stream );
+   return ok;
+}
+
+bool
+mesh_2d::read_front_binary( const char *filename, front_list& fronts )
+{
+   mapped_file mf;
+   const char *cur, *end, *counts;
+   int head[3], n_frts, n_pts, f, j;
+   size_t total;
+
+   if( !mf.open( filename ) )
+      return false;
+
+   cur = mf.data;
+   end = mf.data + mf.size;
+
+   if( mf.size < sizeof(front_magic) + sizeof(head) ||
+       memcmp( cur, front_magic, sizeof(front_magic) ) != 0 )
+   {
+      fprintf( stderr, "%s: not a binary front file\n", filename );
+      return false;
+   }
+   cur += sizeof(front_magic);
+   memcpy( head, cur, sizeof(head) );
+   cur += sizeof(head);
+
+   if( head[1] != front_bom )
+   {
+      fprintf( stderr, "%s: binary front written with another byte order\n", filename );
+      return false;
+   }
+   if( head[0] != front_version )
+   {
+      fprintf( stderr, "%s: binary front version %i not supported\n", filename, head[0] );
+      return false;
+   }
+
+   n_frts = head[2];
+   if( n_frts <= 0 || (size_t)( end - cur ) < n_frts * sizeof(int) )
+   {
+      fprintf( stderr, "%s: invalid number of fronts (%i)\n", filename, n_frts );
+      return false;
+   }
+   //
+   // the counts are summed and checked against the file size before any
+   // allocation
+   //
+   counts = cur;
+   total = 0;
+   for( f = 0 ; f < n_frts ; f++ )
+   {
+      memcpy( &n_pts, counts + f * sizeof(int), sizeof(int) );
+      if( n_pts < 3 )
+      {
+         fprintf( stderr, "%s: front %i has %i points\n", filename, f, n_pts );
+         return false;
+      }
+      total += n_pts;
+   }
+   cur += n_frts * sizeof(int);
+
+   if( (size_t)( end - cur ) % front_record != 0 || (size_t)( end - cur ) / front_record != total )
+   {
+      fprintf( stderr, "%s: expected %lu front records, file size does not match\n",
+               filename, (unsigned long) total );
+      return false;
+   }
+
+   fronts.resize( n_frts );
+   for( f = 0 ; f < n_frts ; f++ )
+   {
+      front_points& fp = fronts[f];
+      memcpy( &n_pts, counts + f * sizeof(int), sizeof(int) );
+      fp.resize( n_pts );
+      for( j = 0 ; j < fp.size() ; j++ )
+      {
+         memcpy( &fp.x[j], cur, sizeof(double) );
+         memcpy( &fp.y[j], cur + sizeof(double), sizeof(double) );
+         memcpy( &fp.bc_type[j], cur + 2 * sizeof(double), sizeof(int) );
+         memcpy( &fp.bc_index[j], cur + 2 * sizeof(double) + sizeof(int), sizeof(int) );
+         memcpy( &fp.bc_surface[j], cur + 2 * sizeof(double) + 2 * sizeof(int), sizeof(int) );
+         cur += front_record;
+      }
+   }
+   return true;
+}
+
+bool
+mesh_2d::write_front_binary( const char *filename, const front_list& fronts )
+{
+   char rec[ front_record ];
+   int head[3], f, j, n_pts;
+
+   FILE *stream = fopen( filename, "wb" );
+   if( stream == 0 )
+   {
+      fprintf( stderr, "%s: unable to create the front file\n", filename );
+      return false;
+   }
+
+   head[0] = front_version;
+   head[1] = front_bom;
+   head[2] = fronts.size();
+
+   fwrite( front_magic, sizeof(front_magic), 1, stream );
+   fwrite( head, sizeof(head), 1, stream );
+
+   for( f = 0 ; f < (int) fronts.size() ; f++ )
+   {
+      n_pts = fronts[f].size();
+      fwrite( &n_pts, sizeof(int), 1, stream );
+   }
+
+   for( f = 0 ; f < (int) fronts.size() ; f++ )
+   {
+      const front_points& fp = fronts[f];
+      for( j = 0 ; j < fp.size() ; j++ )
+      {
+         memcpy( rec, &fp.x[j], sizeof(double) );
+         memcpy( rec + sizeof(double), &fp.y[j], sizeof(double) );
+         memcpy( rec + 2 * sizeof(double), &fp.bc_type[j], sizeof(int) );
+         memcpy( rec + 2 * sizeof(double) + sizeof(int), &fp.bc_index[j], sizeof(int) );
+         memcpy( rec + 2 * sizeof(double) + 2 * sizeof(int), &fp.bc_surface[j], sizeof(int) );
+         fwrite( rec, sizeof(rec), 1, stream );
+      }
+   }
+
+   bool ok = ( ferror( stream ) == 0 );
+   fclose( stream );
+   if( !ok )
+      fprintf( stderr, "%s: error writing the front file\n", filename );
+   return ok;
+}
+
+void
+mesh_2d::add_fronts( fist2d& m, const front_list& fronts )
+{
+   int f;
+
+   for( f = 0 ; f < (int) fronts.size() ; f++ )
+   {
+      const front_points& fp = fronts[f];
+      m.add_front( fp.size(), &fp.x[0], &fp.y[0], &fp.bc_type[0],
+                   &fp.bc_index[0], &fp.bc_surface[0] );
+   }
+}
+
+//***EOF************************************************************************
@@ -0,0 +1,78 @@
+/***************************************************************************
+                            mesh generation code
+                            --------------------
+    front input: text and binary front files
+    copyright               : (C) 2001 by Joao Carlos de Campos Henriques
+    email                   : jcch@popsrv.ist.utl.pt
+ ***************************************************************************/
+
+#ifndef T_MESH2D_FRONT_H
+#define T_MESH2D_FRONT_H
+
+#include <vector>
+#include "t_mesh2d.h"
+
+namespace mesh_2d {
+
+//
+// one closed front stored by attribute, ready for fist2d::add_front
+//
+struct front_points
+{
+   vector<double>  x;
+   vector<double>  y;
+   vector<int>     bc_type;
+   vector<int>     bc_index;
+   vector<int>     bc_surface;
+
+   int  size() const { return x.size(); }
+
+   void resize( int n )
+   {
+      x.resize( n );
+      y.resize( n );
+      bc_type.resize( n );
+      bc_index.resize( n );
+      bc_surface.resize( n );
+   }
+};
+
+typedef vector<front_points>  front_list;
+
+//
+// Text front file:
+//
+//    n_fronts
+//    n_points            (for each front)
+//    x y bc_type         (n_points lines)
+//
+// The last point of a front is dropped only when it repeats the first one.
+// Parse errors are reported as "file:line:column: message" and false is
+// returned.
+//
+bool read_front_text( const char *filename, front_list& fronts );
+
+//
+// Binary front file, native byte order:
+//
+//    char[8]   magic "FIST2DF"
+//    int       version
+//    int       byte order mark (0x01020304)
+//    int       n_fronts
+//    int       n_points[n_fronts]
+//    records   { double x, y; int bc_type, bc_index, bc_surface } packed,
+//              28 bytes each
+//
+// The fronts are stored open, without the closing point.
+//
+bool read_front_binary( const char *filename, front_list& fronts );
+bool write_front_binary( const char *filename, const front_list& fronts );
+
+bool is_front_binary( const char *filename );
+
+void add_fronts( fist2d& m, const front_list& fronts );
+
+}; // namespace mesh_2d
+#endif
+
+//***EOF************************************************************************
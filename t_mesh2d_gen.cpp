@@ -11,12 +11,16 @@
 #include <config.h>
 #endif
 
+#include <algorithm>
+#include <map>
+
 #include "t_mesh2d.h"
 
 namespace mesh_2d
 {
    const double golden_ratio = 0.5 * ( sqrt( 5.0 ) - 1.0 );
    const double mesh_eps  = 1E-15;
+   const double angle_eps = 1E-8;
 
    const double S2min_S2max = 1.0 - golden_ratio;
    const double S2max_S2min = 1.0 / S2min_S2max;
@@ -37,11 +41,38 @@ using namespace mesh_2d;
 
 mesh2d::mesh2d( node2d* (*ndalloc)(int), cell2d* (*clalloc)(int),
                 link2d* (*lkalloc)(int), edge2d* (*edalloc)() )
-              : fist2d( ndalloc, clalloc, lkalloc, edalloc )
+              : fist2d( ndalloc, clalloc, lkalloc, edalloc ), spill_cell( 0 )
 {
   back_start = 0;
+  implicit_id = 0;
+  walk_seed = 1;
+  epoch = 0;
+  star_insertion = false;
   dump_dir = 0;
   dumping_enable = true;
+
+  size_func = 0;
+  size_data = 0;
+  gradation = 0.0;
+  metric_func = 0;
+  metric_data = 0;
+  locate_cells = locate_cell_id = locate_node_id = -1;
+
+  spill_node.p.x = spill_node.p.y = 1E+30;
+  for( int i = 0 ; i < 3 ; i++ )
+     spill_cell.face[i].node = &spill_node;
+  spill_cell.bad = false;
+  spill_cell.rc = -1.0;
+  spill_chunk = 0;
+  spill_nodes_file = spill_cells_file = spill_faces_file = 0;
+  spill_num_nodes = spill_num_cells = spill_num_faces = 0;
+}
+
+mesh2d::~mesh2d()
+{
+  if( spill_nodes_file ) fclose( spill_nodes_file );
+  if( spill_cells_file ) fclose( spill_cells_file );
+  if( spill_faces_file ) fclose( spill_faces_file );
 }
 
 void
@@ -113,8 +144,6 @@ mesh2d::create_back_mesh()
    cell2d_set::iterator itc, itb, ita;
    cell2d *cc, *cb, *ca;
    face2d *f;
-   node2d *nn, *np, *ns;
-   double nx, ny, meas;
    int i, fid;
 
    make_delaunay( &bad_cells );
@@ -160,55 +189,166 @@ mesh2d::create_back_mesh()
 
       }
    }
-   //
-   // evaluate cell gradient
-   //
-   for( itb = back_mesh.begin() ; itb != back_mesh.end() ; itb++ )
-   {
-      cb = *itb;
+   set_back_planes();
+}
 
-      for( i = 0 ; i < 3 ; i++ )
-      {
-         f = cb->face+i;
+//
+// evaluate cell gradient and spacing plane of the background cells, the
+// user spacing is taken at the nodes first so that the planes, the
+// gradation and the node tests all see it
+//
+void
+mesh2d::set_back_planes()
+{
+   cell2d_set::iterator itb;
+   node2d *n;
+   unsigned stamp;
+   int i;
 
-         nn = f->node;
-         ns = succ_node( f );
-         np = pred_node( f );
+   back_array.assign( back_mesh.begin(), back_mesh.end() );
+   if( has_user_size() )
+   {
+      stamp = next_epoch();
+      for( itb = back_mesh.begin() ; itb != back_mesh.end() ; itb++ )
+         for( i = 0 ; i < 3 ; i++ )
+         {
+            n = (*itb)->face[i].node;
+            if( n->mark == stamp )
+               continue;
+            n->mark = stamp;
+            n->h = min( n->h, user_size( n->p.x, n->p.y ) );
+         }
+   }
+   if( gradation > 0.0 )
+      limit_gradation();
+   if( metric_func != 0 )
+      set_back_metric();
+   for( itb = back_mesh.begin() ; itb != back_mesh.end() ; itb++ )
+      set_back_spacing( *itb );
+}
 
-         nx = + np->p.y - ns->p.y;
-         ny = - np->p.x + ns->p.x;
+//
+// divided difference of -ln h at a and b, 1/a when they are close
+//
+static inline double
+log_divided( double a, double b )
+{
+   double d = b - a;
+   if( fabs( d ) < 1E-6 * a )
+      return( -( 1.0 - 0.5 * d / a ) / a );
+   return( -log( b / a ) / d );
+}
 
-         cb->dh_dx += nn->h * nx;
-         cb->dh_dy += nn->h * ny;
-      }
+//
+// Integral of 1/h^2 over a cell where h is linear, as interpolate gives
+// it: twice the area times the second divided difference of -ln h at the
+// node values.
+//
+static double
+inverse_square_integral( double area, double h0, double h1, double h2 )
+{
+   double a = min( h0, min( h1, h2 ) ), c = max( h0, max( h1, h2 ) );
+   double b = h0 + h1 + h2 - a - c;
 
-      meas = cell_area( cb );
-      cb->dh_dx /= meas;
-      cb->dh_dy /= meas;
-   }
+   if( c - a < 1E-6 * c )
+      return( area / sqr( b ) );
+   return( 2.0 * area * ( log_divided( b, c ) - log_divided( a, b ) ) / ( c - a ) );
 }
 
-double
-mesh2d::interpolate( cell2d *bc, node2d *n2 )
+void
+mesh2d::estimate_mesh_size( int *nodes, int *cells, int *edges, size_t *bytes )
 {
-   double X1 = bc->face[0].node->p.x;
-   double Y1 = bc->face[0].node->p.y;
-   double h1 = bc->face[0].node->h;
+   //
+   // The generated cells have a mean side of about h / sin60, where the
+   // front puts the new points: an area of h^2 / sqrt(3), so the number of
+   // cells is the integral of sqrt(3) / h^2 over the domain, evaluated on
+   // the background mesh. Before mesh_generation the boundary triangulation
+   // is made Delaunay, as create_back_mesh will do, and the user spacing is
+   // taken at its nodes. The nodes and edges follow from Euler's formula,
+   // V = ( T + B ) / 2 + 2 C - L with C pieces of domain and L boundary
+   // loops: one per piece and one per hole.
+   //
+   bool before = back_mesh.empty();
+   cell2d_set *s = ( before ? &bad_cells : &back_mesh );
+   cell2d_set::iterator it;
+   map<node2d*, node2d*> next;
+   map<node2d*, node2d*>::iterator itn;
+   vector<cell2d*> stack;
+   cell2d *c, *d;
+   node2d *n;
+   face2d *f;
+   double sum = 0.0, h[3];
+   unsigned stamp;
+   int i, nb = 0, nc, pieces = 0, loops = 0;
 
-   double X2 = bc->face[2].node->p.x;
-   double Y2 = bc->face[2].node->p.y;
-   double h2 = bc->face[2].node->h;
+   if( before )
+      make_delaunay( &bad_cells );
 
-   double X3 = bc->face[1].node->p.x;
-   double Y3 = bc->face[1].node->p.y;
-   double h3 = bc->face[1].node->h;
+   for( it = s->begin() ; it != s->end() ; it++ )
+   {
+      c = *it;
+      for( i = 0 ; i < 3 ; i++ )
+      {
+         if( c->face[i].adj == 0 )
+         {
+            next[ succ_node( c->face+i ) ] = pred_node( c->face+i );
+            nb++;
+         }
+         n = c->face[i].node;
+         h[i] = ( before && has_user_size() ? min( n->h, user_size( n->p.x, n->p.y ) ) : n->h );
+      }
+      sum += inverse_square_integral( cell_area( c ), h[0], h[1], h[2] );
+   }
+   //
+   // the boundary loops, following the faces from node to node
+   //
+   stamp = next_epoch();
+   for( itn = next.begin() ; itn != next.end() ; itn++ )
+   {
+      if( itn->first->mark == stamp )
+         continue;
+      for( n = itn->first ; n != 0 && n->mark != stamp ; )
+      {
+         n->mark = stamp;
+         map<node2d*, node2d*>::iterator itm = next.find( n );
+         n = ( itm == next.end() ? 0 : itm->second );
+      }
+      loops++;
+   }
+   //
+   // the pieces of domain, walking the cells through their faces
+   //
+   stamp = next_epoch();
+   for( it = s->begin() ; it != s->end() ; it++ )
+   {
+      if( (*it)->mark == stamp )
+         continue;
+      (*it)->mark = stamp;
+      stack.push_back( *it );
+      while( !stack.empty() )
+      {
+         c = stack.back();
+         stack.pop_back();
+         for( i = 0 ; i < 3 ; i++ )
+         {
+            f = c->face[i].adj;
+            if( f == 0 || ( d = f->cell )->mark == stamp )
+               continue;
+            d->mark = stamp;
+            stack.push_back( d );
+         }
+      }
+      pieces++;
+   }
 
-   double ar = ( X2*Y3 + X1*Y2 + X3*Y1 - Y1*X2 - Y2*X3 - Y3*X1 );
-   double a1 = ( h1*(X2*Y3-X3*Y2) + h2*(X3*Y1-X1*Y3) + h3*(X1*Y2-X2*Y1) ) / ar;
-   double a2 = ( h1*(Y2-Y3) + h2*(Y3-Y1) + h3*(Y1-Y2) ) / ar;
-   double a3 = ( h1*(X3-X2) + h2*(X1-X3) + h3*(X2-X1) ) / ar;
+   nc = (int)( sqrt( 3.0 ) * sum + 0.5 );
+   *cells = nc;
+   *nodes = max( 3, ( nc + nb ) / 2 + 2 * pieces - loops );
+   *edges = ( 3 * nc + nb ) / 2;
 
-   return( a1 + a2 * n2->p.x + a3 * n2->p.y );
+   if( bytes != 0 )     // plus the list and set node overheads
+      *bytes = *nodes * ( sizeof(node2d) + 3 * sizeof(void*) ) +
+               nc * ( sizeof(cell2d) + 5 * sizeof(void*) );
 }
 
 void
@@ -235,27 +375,101 @@ mesh2d::new_point( edge2d *be )
 
    cell2d *cb = find_back_cell( n2 );
 
+   if( metric_func != 0 )
+   {
+      new_point_metric( be, cb );
+      return;
+   }
+
    double hm = interpolate( cb, n2 );
-   double lm = hm / ( sin60 - 0.5 * ( cb->dh_dx * nx + cb->dh_dy * ny ) );
+   double gm = 0.5 * ( cb->dh_dx * nx + cb->dh_dy * ny );
+   //
+   // the user spacing has no gradient, it is not used to place the node
+   //
+   if( has_user_size() )
+   {
+      double hu = user_size( n2->p.x, n2->p.y );
+      if( hu < hm )
+      {
+         hm = hu;
+         gm = 0.0;
+      }
+   }
+   double lm = hm / ( sin60 - gm );
 
    double lmin = nn * sqrt( S2min_S2max - 0.25 );
    double lmax = nn * sqrt( S2max_S2min - 0.25 );
 
+   n2->h  = hm;
+   //
+   // A front much coarser than the user spacing is placed at lmin, the new
+   // sides are sqrt( S2min_S2max ) of the edge: the node gets their length
+   // and the front shrinks over the cycles down to the user spacing.
+   //
+   if( has_user_size() && lm < lmin )
+      n2->h = sqrt( S2min_S2max ) * nn;
+
    lm = max( lmin, min( lm, lmax ) );
    n2->p.x += lm * nx;
    n2->p.y += lm * ny;
-   n2->h  = hm;
 
    be->ins_cell = find_bad_cell( be->adj->cell, n2 );
 }
 
+//
+// Rotates around the end of the boundary face bf of cl closer to n while n
+// stays behind the boundary, moving along the boundary in one direction.
+// Returns the cell of the first boundary face that does not hide n, 0 if
+// the number of boundary faces to follow is exceeded.
+//
 cell2d*
-mesh2d::find_cell( cell2d_set* st, cell2d *cl, node2d *n )
+mesh2d::step_around_boundary( cell2d *cl, int bf, node2d *n )
 {
-   // cl is the starting cell
-   int i, a[3];
+   node2d *v, *u;
+   face2d *f;
+   int iv, g, cnt;
+
+   u = succ_node( cl->face+bf );
+   v = pred_node( cl->face+bf );
+   if( norm_sqr( u->p.x - n->p.x, u->p.y - n->p.y ) < norm_sqr( v->p.x - n->p.x, v->p.y - n->p.y ) )
+      v = u;
 
-   while( cl != 0 )
+   for( cnt = 0 ; cnt < 64 ; cnt++ )
+   {
+      for( iv = 0 ; cl->face[iv].node != v ; iv++ );
+      g = 3 - iv - bf;
+      while( ( f = cl->face[g].adj ) != 0 && f->cell != &spill_cell )
+      {
+         cl = f->cell;
+         for( iv = 0 ; cl->face[iv].node != v ; iv++ );
+         g = 3 - iv - f->id;
+      }
+      //
+      // cl->face[g] is the next boundary face, from v to its other end
+      //
+      if( det( succ_node( cl->face+g ), pred_node( cl->face+g ), n ) <= 0 )
+         return cl;
+      bf = g;
+      v  = cl->face[ 3 - iv - g ].node;
+   }
+   return 0;
+}
+
+//
+// Visibility walk from cl towards n. The exit face is tried from a random
+// position, which breaks the cycles of non-Delaunay triangulations. When n
+// is behind the domain boundary the walk steps around the boundary faces.
+// Returns 0 when n was not reached. Only seed is written, concurrent walks
+// with their own seeds are safe.
+//
+cell2d*
+mesh2d::walk_cell( cell2d *cl, node2d *n, unsigned& seed )
+{
+   cell2d *prv = 0, *nxt;
+   face2d *f;
+   int i, j, k, bf, a[3], steps, around = 0;
+
+   for( steps = 0 ; cl != 0 && steps < ( 1 << 16 ) ; steps++ )
    {
       a[0] = det( cl->face[1].node, cl->face[2].node, n );
       a[1] = det( cl->face[2].node, cl->face[0].node, n );
@@ -264,23 +478,82 @@ mesh2d::find_cell( cell2d_set* st, cell2d *cl, node2d *n )
       if( a[0] <= 0 && a[1] <= 0 && a[2] <= 0 )
          return cl;
 
-      for( i = 0 ; i < 3 ; i++ )
-         if( a[i] > 0 && cl->face[i].adj )
-         {
-            cl = cl->face[i].adj->cell;
-            continue;
-         }
-      //
-      // co-linear case, it is our last chance
-      //
-      for( i = 0 ; i < 3 ; i++ )
-         if( a[i] == 0 && cl->face[i].adj )
+      nxt = 0;
+      bf = -1;
+      k = walk_random( seed ) % 3;
+      for( j = 0 ; j < 3 && nxt == 0 ; j++ )
+      {
+         i = ( k + j ) % 3;
+         f = cl->face[i].adj;
+         if( a[i] > 0 )
          {
-            cl = cl->face[i].adj->cell;
-            continue;
+            if( f == 0 || f->cell == &spill_cell )
+               bf = i;
+            else if( f->cell != prv )
+               nxt = f->cell;
          }
-      break;
+      }
+
+      if( nxt == 0 && bf >= 0 )
+      {
+         if( around++ == 4 )
+            return 0;
+         prv = 0;
+         cl  = step_around_boundary( cl, bf, n );
+         continue;
+      }
+
+      prv = cl;
+      cl  = nxt;
+   }
+   return 0;
+}
+
+//
+// Jump-and-walk: sample ~N^(1/3) bad cells, walk from the nearest one and
+// from the next ones when a non-convex bad region blocks the walk.
+//
+cell2d*
+mesh2d::jump_and_walk( node2d *n )
+{
+   cell2d *cl, *found;
+   double xm, ym;
+   int i, num, ns;
+
+   num = bad_array.size();
+   if( num == 0 )
+      return 0;
+
+   ns = (int) cbrt( (double) num ) + 1;
+   walk_samples.resize( ns );
+   for( i = 0 ; i < ns ; i++ )
+   {
+      cl = bad_array[ ( walk_random() * 32768u + walk_random() ) % num ];
+      xm = ( cl->face[0].node->p.x + cl->face[1].node->p.x + cl->face[2].node->p.x ) / 3.0;
+      ym = ( cl->face[0].node->p.y + cl->face[1].node->p.y + cl->face[2].node->p.y ) / 3.0;
+      walk_samples[i].first  = norm_sqr( xm - n->p.x, ym - n->p.y );
+      walk_samples[i].second = cl;
+   }
+   sort( walk_samples.begin(), walk_samples.end(), smaller_sample() );
+
+   for( i = 0 ; i < ns ; i++ )
+   {
+      found = walk_cell( walk_samples[i].second, n );
+      if( found != 0 )
+         return found;
    }
+   return 0;
+}
+
+cell2d*
+mesh2d::find_cell( cell2d_set* st, cell2d *cl, node2d *n )
+{
+   // cl is the starting cell
+   int a[3];
+
+   cell2d *found = walk_cell( cl, n );
+   if( found != 0 )
+      return found;
    //
    // because the domain is not always convex we may need a global search
    //
@@ -300,47 +573,66 @@ mesh2d::find_cell( cell2d_set* st, cell2d *cl, node2d *n )
    return 0;
 }
 
+//
+// The walk may be stopped by the holes of the background mesh: before the
+// global search it is tried from ~N^(1/3) evenly spaced cells, the nearest
+// first, with its own random state.
+//
 cell2d*
 mesh2d::find_back_cell( node2d *n )
 {
+   vector<pair<double,cell2d*> > samples;
+   cell2d *cl, *found;
+   unsigned seed = 1;
+   int i, num, ns;
+
    if( back_start == 0 )
       back_start = *back_mesh.begin();
-   back_start = find_cell( &back_mesh, back_start, n );
+   found = walk_cell( back_start, n );
+
+   num = back_array.size();
+   if( found == 0 && num > 0 )
+   {
+      ns = (int) cbrt( (double) num ) + 1;
+      samples.resize( ns );
+      for( i = 0 ; i < ns ; i++ )
+      {
+         cl = back_array[ (size_t) i * num / ns ];
+         samples[i].first  = norm_sqr( ( cl->face[0].node->p.x + cl->face[1].node->p.x +
+                                         cl->face[2].node->p.x ) / 3.0 - n->p.x,
+                                       ( cl->face[0].node->p.y + cl->face[1].node->p.y +
+                                         cl->face[2].node->p.y ) / 3.0 - n->p.y );
+         samples[i].second = cl;
+      }
+      sort( samples.begin(), samples.end(), smaller_sample() );
+      for( i = 0 ; i < ns && found == 0 ; i++ )
+         found = walk_cell( samples[i].second, n, seed );
+   }
+   if( found == 0 )
+      found = find_cell( &back_mesh, 0, n );
+   back_start = found;
    return back_start;
 }
 
 cell2d*
 mesh2d::find_bad_cell( cell2d *cl, node2d *n )
 {
-   return find_cell( &bad_cells, cl, n );
+   cell2d *found = walk_cell( cl, n );
+   if( found == 0 )
+      found = jump_and_walk( n );
+   if( found == 0 )                           // n is outside the domain
+      found = find_cell( &bad_cells, 0, n );
+   return found;
 }
 
 void
 mesh2d::detach_bad_edges( cell2d *c )
 {
-   edge2d_set_addr::iterator it;
-   edge2d e, *a;
    int i;
 
    for( i = 0 ; i < 3 ; i++ )
-   {
-      e.n0 = succ_node( c->face+i );
-      e.n1 = pred_node( c->face+i );
-
-      it = frontal_edges.find( &e );
-      if( it != frontal_edges.end() )
-      {
-         a = *it;
-         a->adj = 0;
-      }
-   }
-}
-
-inline bool
-inside_circuncircle( cell2d *c, node2d *n )
-{
-   double r = norm( c->xc - n->p.x, c->yc - n->p.y ) * ( 1.0 - 1E-8 );
-   return( r <= c->rc );
+      if( c->face[i].edge != 0 )
+         c->face[i].edge->adj = 0;
 }
 
 void
@@ -350,26 +642,75 @@ attach_links( link2d *prv, link2d *nxt )
    nxt->prev = prv;
 }
 
+//
+// Stamps are compared with the current epoch, a wrap around clears them.
+// Links are only stamped while they are created, they start at 0.
+//
+unsigned
+mesh2d::next_epoch()
+{
+   cell2d_set::iterator it;
+   node2d_list::iterator itn;
+
+   if( ++epoch == 0 )
+   {
+      for( it = bad_cells.begin() ; it != bad_cells.end() ; it++ )
+         (*it)->mark = 0;
+      for( it = mesh_cells.begin() ; it != mesh_cells.end() ; it++ )
+         (*it)->mark = 0;
+      for( it = back_mesh.begin() ; it != back_mesh.end() ; it++ )
+         (*it)->mark = 0;
+      for( itn = mesh_nodes.begin() ; itn != mesh_nodes.end() ; itn++ )
+         (*itn)->mark = 0;
+      spill_cell.mark = 0;
+      epoch = 1;
+   }
+   return epoch;
+}
+
+//
+// min-heap on the smaller_addr key, pops the links in the std::set order
+//
+struct larger_addr
+{
+   bool operator () ( link2d* a, link2d* b ) const
+   {
+      return smaller_addr()( b, a );
+   }
+};
+
+inline void
+push_untested( vector<link2d*>& heap, link2d *l, unsigned stamp )
+{
+   l->mark = stamp;
+   heap.push_back( l );
+   push_heap( heap.begin(), heap.end(), larger_addr() );
+}
+
 void
 mesh2d::create_fist_front( cell2d *c, node2d *n )
 {
    //
    // it is assumed that c contains n
    //
-   link2d_set_addr::iterator itl;
-   link2d_set_addr untested;
-
-   cell2d_set::iterator itt;
-   cell2d_set trash;
-
+   // untested links are stamped with the current epoch and kept in
+   // link_heap, a link is removed by clearing its stamp. The cavity cells
+   // are stamped too and collected in cell_stack.
+   //
    link2d *l[3], *cur, *l0, *l1, *prv, *nxt;
    face2d *adj0, *adj1, *face;
    node2d *nod0, *nod1;
+   unsigned stamp;
    int i;
 
    if( fist_front.size() != 0 )
       THROW__X( "mesh2d::create_fist_front: fist_front.size() != 0\n" );
 
+   stamp = next_epoch();
+   link_heap.clear();
+   link_stack.clear();
+   cell_stack.clear();
+
    for( i = 0 ; i < 3 ; i++ )
    {
       l[i] = link_alloc( ++cur_link_id );
@@ -380,16 +721,21 @@ mesh2d::create_fist_front( cell2d *c, node2d *n )
       l[i]->next = l[ succ[i] ];
       l[i]->prev = l[ pred[i] ];
       l[i]->adj  = c->face[ pred[i] ].adj;
-      untested.insert( l[i] );
+      l[i]->edge = c->face[ pred[i] ].edge;
+      push_untested( link_heap, l[i], stamp );
    }
-   trash.insert( c );
+   c->mark = stamp;
+   cell_stack.push_back( c );
 
-   while( !untested.empty() )
+   while( !link_heap.empty() )
    {
-      itl = untested.begin();
-      cur = *itl;
+      pop_heap( link_heap.begin(), link_heap.end(), larger_addr() );
+      cur = link_heap.back();
+      link_heap.pop_back();
 
-      untested.erase( itl );
+      if( cur->mark != stamp )         // erased
+         continue;
+      cur->mark = 0;
       face = cur->adj;
 
       if( face != 0 && inside_circuncircle( face->cell, n ) )
@@ -403,65 +749,173 @@ mesh2d::create_fist_front( cell2d *c, node2d *n )
          adj0 = succ_face( face )->adj;
          adj1 = pred_face( face )->adj;
 
-         itt = trash.find( face->cell );
-         if( itt == trash.end() )
-            trash.insert( face->cell );
+         if( face->cell->mark != stamp )
+         {
+            face->cell->mark = stamp;
+            cell_stack.push_back( face->cell );
+         }
 
          l0 = cur;
          l0->node = nod0;
          l0->adj = adj0;
+         l0->edge = succ_face( face )->edge;
 
          l1 = link_alloc( ++cur_link_id );
          l1->node = nod1;
          l1->adj = adj1;
+         l1->edge = pred_face( face )->edge;
 
          attach_links( prv, l0 );
          attach_links( l0, l1 );
          attach_links( l1, nxt );
 
-         untested.insert( l0 );
-         untested.insert( l1 );
+         push_untested( link_heap, l0, stamp );
+         push_untested( link_heap, l1, stamp );
          //
          // test unusual cases
          //
          if( prv->node == l0->next->node )
          {
-            untested.erase( prv );
-            untested.erase( l0 );
+            prv->mark = l0->mark = 0;
             attach_links( prv->prev, l0->next );
-            delete prv;
-            delete l0;
+            link_stack.push_back( prv );
+            link_stack.push_back( l0 );
          }
          if( l1->node == nxt->next->node )
          {
-            untested.erase( l1 );
-            untested.erase( nxt );
+            l1->mark = nxt->mark = 0;
             attach_links( l1->prev, nxt->next );
-            delete l1;
-            delete nxt;
+            link_stack.push_back( l1 );
+            link_stack.push_back( nxt );
          }
       }
       else
          fist_front.insert( cur );
    }
    //
-   // delete all intersected cells
+   // the heap may still point to the removed links, delete them now
+   //
+   for( i = 0 ; i < (int) link_stack.size() ; i++ )
+      delete link_stack[i];
    //
-   for( itt = trash.begin() ; itt != trash.end() ; itt++ )
+   // detach all intersected cells, they are kept in cell_stack to be reused
+   // by create_star_cells and deleted by delete_cavity_cells
+   //
+   for( i = 0 ; i < (int) cell_stack.size() ; i++ )
    {
-      c = *itt;
-      for( i = 0 ; i < 3 ; i++ )
+      c = cell_stack[i];
+      for( int j = 0 ; j < 3 ; j++ )
       {
-         face = c->face[i].adj;
+         face = c->face[j].adj;
          if( face != 0 )
             face->adj = 0;
       }
-      bad_cells.erase( c );
+      erase_bad_cell( c );
       detach_bad_edges( c );
-      delete c;
    }
 }
 
+void
+mesh2d::delete_cavity_cells()
+{
+   int i;
+
+   for( i = 0 ; i < (int) cell_stack.size() ; i++ )
+      delete cell_stack[i];
+   cell_stack.clear();
+}
+
+//
+// The Bowyer-Watson cavity in fist_front is star-shaped from n: connect n
+// to every cavity edge, reusing the deleted cells. Returns false, with
+// nothing changed, when some edge does not see n (n outside the cavity or a
+// degenerate loop); the FIST triangulation must then be used.
+//
+bool
+mesh2d::create_star_cells( node2d *n )
+{
+   link2d *first, *l, *nxt;
+   cell2d *c, *c0 = 0, *cp = 0;
+   int k, num = fist_front.size();
+
+   first = *fist_front.begin();
+   l = first;
+   k = 0;
+   do {
+      if( det( l->node, l->next->node, n ) >= 0 || ++k > num )
+         return false;
+      l = l->next;
+   } while( l != first );
+
+   if( k != num )
+      return false;
+
+   mesh_nodes.push_back( n );
+
+   do {
+      if( cell_stack.empty() )
+         c = cell_alloc( ++cur_cell_id );
+      else
+      {
+         c = cell_stack.back();
+         cell_stack.pop_back();
+         c->reset( ++cur_cell_id );
+      }
+
+      c->face[0].node = l->node;
+      c->face[1].node = l->next->node;
+      c->face[2].node = n;
+      c->face[2].edge = l->edge;
+
+      attach_faces( c->face+2, l->adj );
+      if( cp != 0 )
+         attach_faces( cp->face+0, c->face+1 );
+      else
+         c0 = c;
+
+      circun_circle( c );
+      insert_bad_cell( c );
+      attach_bad_edges( c );
+
+      cp = c;
+      l = l->next;
+   } while( l != first );
+
+   attach_faces( cp->face+0, c0->face+1 );
+
+   do {
+      nxt = l->next;
+      delete l;
+      l = nxt;
+   } while( l != first );
+   fist_front.clear();
+
+   return true;
+}
+
+void
+mesh2d::insert_point( edge2d *be )
+{
+   node2d *new_node = be->new_node;
+   cell2d *ins_cell;
+   //
+   // We delete cells each point inserted. Find again...
+   //
+   ins_cell = find_bad_cell( be->adj->cell, new_node );
+   if( ins_cell == 0 )
+      THROW__X( "mesh2d::insert_point: find_cell failed.\n" );
+   //
+   // create front for FIST and create a new triangle updating fist_front
+   //
+   create_fist_front( ins_cell, new_node );
+   if( !star_insertion || !create_star_cells( new_node ) )
+   {
+      create_new_cell( be, new_node );
+      fist_generation();
+   }
+   delete_cavity_cells();
+}
+
 void
 mesh2d::create_new_cell( edge2d *be, node2d *n )
 {
@@ -503,6 +957,7 @@ mesh2d::create_new_cell( edge2d *be, node2d *n )
    c->face[2].node = n;
 
    c->face[2].adj = vip1->adj;
+   c->face[2].edge = vip1->edge;
    if( vip1->adj )
       vip1->adj->adj = c->face+2;
 
@@ -516,9 +971,10 @@ mesh2d::create_new_cell( edge2d *be, node2d *n )
    vim1->prev = l0;
 
    vip1->adj = c->face+1;
+   vip1->edge = 0;
 
    circun_circle( c );
-   bad_cells.insert( c );
+   insert_bad_cell( c );
    attach_bad_edges( c );
 
    fist_front.insert( vip1 );
@@ -532,54 +988,53 @@ mesh2d::is_point_allowed( cell2d *c, node2d *n )
    //
    // it is assumed that c contains n
    //
-   cell2d_set::iterator itt;
-   cell2d_set tested;
-   list<face2d*> untested;
-
    face2d *f, *fa;
+   unsigned stamp;
    int i;
 
    if( !c->bad )
       return false;
 
-   if( is_close_to_existing_node( c, n ) )
+   if( is_close_to_existing_node( c, n ) || is_flat_on_boundary( c, n ) )
       return false;
-   tested.insert( c );
+
+   stamp = next_epoch();
+   c->mark = stamp;
+   face_stack.clear();
 
    for( i = 0 ; i < 3 ; i++ )
    {
       fa = c->face[i].adj;
       if( fa != 0 )
-         untested.push_back( fa );
+         face_stack.push_back( fa );
    }
 
-   while( !untested.empty() )
+   while( !face_stack.empty() )
    {
-      f = untested.front();
-      untested.pop_front();
+      f = face_stack.back();
+      face_stack.pop_back();
       c = f->cell;
 
-      itt = tested.find( c );
-      if( itt != tested.end() )
+      if( c->mark == stamp )           // already tested
          continue;
       else
       {
          if( is_close_to_existing_node( c, n ) )
             return false;
-         tested.insert( c );
+         c->mark = stamp;
 
          if( inside_circuncircle( c, n ) )
          {
-            if( !c->bad )
+            if( !c->bad || is_flat_on_boundary( c, n ) )
                return false;
             else
             {
                fa = succ_face( f )->adj;
                if( fa )
-                  untested.push_back( fa );
+                  face_stack.push_back( fa );
                fa = pred_face( f )->adj;
                if( fa )
-                  untested.push_back( fa );
+                  face_stack.push_back( fa );
             }
          }
       }
@@ -587,6 +1042,41 @@ mesh2d::is_point_allowed( cell2d *c, node2d *n )
    return true;
 }
 
+//
+// The cavity cell c would join n to its boundary faces: not with a height
+// smaller than lmin in new_point. The fronts are not refined, the front of
+// a finer user spacing must not reach them; nor the point of an edge near
+// a boundary face, the front spacing may as well change faster than the
+// boundary spacing. Isotropic spacing only.
+//
+bool
+mesh2d::is_flat_on_boundary( cell2d *c, node2d *n )
+{
+   static const double hmin = sqrt( S2min_S2max - 0.25 );
+
+   face2d *f;
+   node2d *n0, *n1;
+   double ex, ey;
+   int i;
+
+   if( n->m[0] > 0.0 )
+      return false;
+
+   for( i = 0 ; i < 3 ; i++ )
+   {
+      f = c->face+i;
+      if( f->adj != 0 )
+         continue;
+      n0 = succ_node( f );
+      n1 = pred_node( f );
+      ex = n1->p.x - n0->p.x;
+      ey = n1->p.y - n0->p.y;
+      if( fabs( ex * ( n->p.y - n0->p.y ) - ey * ( n->p.x - n0->p.x ) ) < hmin * ( ex * ex + ey * ey ) )
+         return true;
+   }
+   return false;
+}
+
 bool
 mesh2d::is_close_to_existing_node( cell2d *c, node2d *n )
 {
@@ -597,6 +1087,14 @@ mesh2d::is_close_to_existing_node( cell2d *c, node2d *n )
    node2d *w;
    int i;
 
+   if( n->m[0] > 0.0 )                 // the metric length of the edges is 1
+   {
+      for( i = 0 ; i < 3 ; i++ )
+         if( metric_length( n, c->face[i].node ) <= dist_factor )
+            return true;
+      return false;
+   }
+
    for( i = 0 ; i < 3 ; i++ )
    {
       w  = c->face[i].node;
@@ -608,27 +1106,34 @@ mesh2d::is_close_to_existing_node( cell2d *c, node2d *n )
    return false;
 }
 
+//
+// The frontal edges travel with the faces: the cavity links and the FIST
+// cells copy face2d::edge, so only the back-pointer needs to be updated.
+//
 void
 mesh2d::attach_bad_edges( cell2d *c )
 {
-   edge2d_set_addr::iterator it;
-   edge2d e, *a;
-   face2d *f;
    int i;
 
    for( i = 0 ; i < 3 ; i++ )
-   {
-      f = c->face+i;
-      e.n0 = succ_node( f );
-      e.n1 = pred_node( f );
+      if( c->face[i].edge != 0 )
+         c->face[i].edge->adj = c->face+i;
+}
 
-      it = frontal_edges.find( &e );
-      if( it != frontal_edges.end() )
-      {
-         a = *it;
-         a->adj = f;
-      }
+void
+mesh2d::clear_frontal_edges()
+{
+   edge2d_set_addr::iterator it;
+   edge2d *be;
+
+   for( it = frontal_edges.begin() ; it != frontal_edges.end() ; it++ )
+   {
+      be = *it;
+      if( be->adj != 0 )
+         be->adj->edge = 0;
+      delete be;
    }
+   frontal_edges.clear();
 }
 
 void
@@ -640,68 +1145,97 @@ mesh2d::create_frontal_edges()
    // stopped when all the points do not have neighbours.
    // The current algorithm is enough for our purposes and is more fast.
    //
-   edge2d_set_sort::iterator itc, ite;
-   edge2d_set_sort frontal_list_1, frontal_list_2;
-   edge2d_set_sort *frontal_temp, *frontal_wait;
-   edge2d_set_sort neighbours;
-
+   // The sorting keys (edge length, ro, theta) do not change, so the
+   // candidates are sorted once and each pass keeps the survivors in place.
+   //
+   // An edge may ask again for the point it got in an earlier cycle: the
+   // front was much coarser than the spacing and the cell of the edge is
+   // obtuse at that point, it never becomes implicit and nothing else
+   // meshes it. Such cells are taken as good and the candidates are
+   // collected again, the neighbours are now on the front. With a user
+   // spacing this is done at once, its steps leave the coarse cell among
+   // fine ones; with the front spacing only when no candidate is left, a
+   // later cycle usually meshes the cell.
+   //
    cell2d_set::iterator it;
+   vector<cell2d*> stuck;
 
    cell2d *cp;
    node2d *ne, *nc;
    edge2d *be, *bc;
    face2d *f;
 
-   double s2, r2, ex, ey, eh, ec, eo;
+   double s2, r2, ex, ey, eh, ec, eo, em[3];
    bool changed;
-   int i;
+   int i, j, k, num;
 
-   frontal_edges.clear();
-   frontal_temp = &frontal_list_1;
-   frontal_wait = &frontal_list_2;
+   clear_frontal_edges();
 
-   for( it = bad_cells.begin() ; it != bad_cells.end() ; it++ )
-   {
-      cp = *it;
+   do {
+      frontal_sort.clear();
+      stuck.clear();
 
-      for( i = 0 ; i < 3 ; i++ )
+      for( it = bad_cells.begin() ; it != bad_cells.end() ; it++ )
       {
-         f = cp->face + i;
-         if( is_frontal_face( f ) )
+         cp = *it;
+
+         for( i = 0 ; i < 3 ; i++ )
          {
-            be = edge_alloc();
-            be->new_node = node_alloc( ++cur_node_id );
-            be->adj = f;
-            be->n0 = succ_node( f );
-            be->n1 = pred_node( f );
-            be->h  = norm( be->n1->p.x - be->n0->p.x, be->n1->p.y - be->n0->p.y );
-            ex = 0.5 * ( be->n1->p.x + be->n0->p.x ) - x_centroid;
-            ey = 0.5 * ( be->n1->p.y + be->n0->p.y ) - y_centroid;
-            be->theta = atan2pi( ey, ex );
-            be->ro = norm( ex, ey );
-            new_point( be );
-
-            if( be->ins_cell != 0 && is_point_allowed( be->ins_cell, be->new_node ) )
-               frontal_wait->insert( be );
-            else
+            f = cp->face + i;
+            if( is_frontal_face( f ) )
             {
-               delete be->new_node;
-               delete be;
+               be = edge_alloc();
+               be->new_node = node_alloc( ++cur_node_id );
+               be->adj = f;
+               be->n0 = succ_node( f );
+               be->n1 = pred_node( f );
+               be->h  = norm( be->n1->p.x - be->n0->p.x, be->n1->p.y - be->n0->p.y );
+               ex = 0.5 * ( be->n1->p.x + be->n0->p.x ) - x_centroid;
+               ey = 0.5 * ( be->n1->p.y + be->n0->p.y ) - y_centroid;
+               be->theta = atan2pi( ey, ex );
+               be->ro = norm( ex, ey );
+               new_point( be );
+
+               if( be->ins_cell != 0 && is_point_allowed( be->ins_cell, be->new_node ) )
+                  frontal_sort.push_back( be );
+               else
+               {
+                  ne = be->new_node;
+                  if( norm_sqr( f->node->p.x - ne->p.x, f->node->p.y - ne->p.y ) <= sqr( 1E-9 * be->h ) )
+                     stuck.push_back( cp );
+                  delete ne;
+                  delete be;
+               }
             }
          }
       }
-   }
+
+      if( stuck.empty() || ( !has_user_size() && !frontal_sort.empty() ) )
+         break;
+      for( i = 0 ; i < (int) frontal_sort.size() ; i++ )
+      {
+         delete frontal_sort[i]->new_node;
+         delete frontal_sort[i];
+      }
+      for( i = 0 ; i < (int) stuck.size() ; i++ )
+         if( stuck[i]->bad )
+         {
+            erase_bad_cell( stuck[i] );
+            stuck[i]->bad = false;
+            mesh_cells.insert( stuck[i] );
+         }
+   } while( true );
+
+   sort( frontal_sort.begin(), frontal_sort.end(), smaller_eht() );
+   num = frontal_sort.size();
 
    do {
       changed = false;
-      swap( frontal_wait, frontal_temp );
 
-      while( !frontal_temp->empty() )
+      for( i = k = 0 ; i < num ; i++ )
       {
-         ite = frontal_temp->begin();
-         be = *ite;
+         be = frontal_sort[i];
          ne = be->new_node;
-         frontal_temp->erase( ite );
 
          if( ne == 0 )
          {
@@ -710,21 +1244,27 @@ mesh2d::create_frontal_edges()
          }
          //
          // let us collect all the neighbours by
-         // checking only the remainder of the set
+         // checking only the remainder of the list
          //
          neighbours.clear();
-         for( itc = frontal_temp->begin() ; itc != frontal_temp->end() ; itc++ )
+         for( j = i + 1 ; j < num ; j++ )
          {
-            bc = *itc;
+            bc = frontal_sort[j];
             nc = bc->new_node;
 
             if( nc == 0 )
                continue;
 
+            if( ne->m[0] > 0.0 )
+            {
+               if( metric_length( ne, nc ) <= dist_factor )
+                  neighbours.push_back( bc );
+               continue;
+            }
             s2 = norm_sqr( ne->p.x - nc->p.x, ne->p.y - nc->p.y );
             r2 = sqr( dist_factor * 0.5 * ( ne->h + nc->h ) );
             if( s2 <= r2 )
-               neighbours.insert( bc );
+               neighbours.push_back( bc );
          }
          //
          // evaluate average values
@@ -734,39 +1274,44 @@ mesh2d::create_frontal_edges()
          eo = 1.0 / ne->h;
          eh = ne->h;
          ec = 1.0;
+         em[0] = ne->m[0] / ne->h;
+         em[1] = ne->m[1] / ne->h;
+         em[2] = ne->m[2] / ne->h;
 
          if( !neighbours.empty() ) changed = true;
 
-         for( itc = neighbours.begin() ; itc != neighbours.end() ; itc++ )
+         for( j = 0 ; j < (int) neighbours.size() ; j++ )
          {
-            bc = *itc;
-            nc = bc->new_node;
-
-            if( nc == 0 )
-               continue;
+            nc = neighbours[j]->new_node;
 
             ex += nc->p.x / nc->h;
             ey += nc->p.y / nc->h;
             eo += 1.0 / nc->h;
             eh += nc->h;
             ec += 1.0;
+            em[0] += nc->m[0] / nc->h;
+            em[1] += nc->m[1] / nc->h;
+            em[2] += nc->m[2] / nc->h;
          }
          ne->p.x = ex / eo;
          ne->p.y = ey / eo;
          ne->h = eh / ec;
+         ne->m[0] = em[0] / eo;
+         ne->m[1] = em[1] / eo;
+         ne->m[2] = em[2] / eo;
 
          be->ins_cell = find_bad_cell( be->ins_cell, ne );
          if( be->ins_cell != 0 &&
              is_point_allowed( be->ins_cell, ne ) )//&&
              //!is_close_to_frontal_face( be->ins_cell, ne ) )
          {
-            frontal_wait->insert( be );
+            frontal_sort[k++] = be;     // k <= i, the remainder is untouched
             //
             // the neighbours are useless, mark it
             //
-            for( itc = neighbours.begin() ; itc != neighbours.end() ; itc++ )
+            for( j = 0 ; j < (int) neighbours.size() ; j++ )
             {
-               bc = *itc;
+               bc = neighbours[j];
                delete bc->new_node;
                bc->new_node = 0;
             }
@@ -777,14 +1322,152 @@ mesh2d::create_frontal_edges()
             delete be;
          }
       }
+      num = k;
 
    } while( changed );
 
-   while( !frontal_wait->empty() )
+   for( i = 0 ; i < num ; i++ )
+   {
+      be = frontal_sort[i];
+      be->adj->edge = be;
+      frontal_edges.insert( be );
+   }
+   frontal_sort.clear();
+}
+
+void
+mesh2d::set_out_of_core( int chunk )
+{
+   if( spill_nodes_file == 0 )
+   {
+      spill_nodes_file = tmpfile();
+      spill_cells_file = tmpfile();
+      spill_faces_file = tmpfile();
+      if( !spill_nodes_file || !spill_cells_file || !spill_faces_file )
+         THROW__X( "mesh2d::set_out_of_core: unable to create the temporary files.\n" );
+   }
+   spill_chunk = ( chunk > 0 ? chunk : 1 );
+   spill_nodes_buf.reserve( spill_chunk );
+   spill_cells_buf.reserve( spill_chunk );
+   spill_faces_buf.reserve( spill_chunk );
+}
+
+template<class T>
+static void
+write_spill( vector<T>& buf, FILE *stream )
+{
+   if( !buf.empty() && fwrite( &buf[0], sizeof(T), buf.size(), stream ) != buf.size() )
+      THROW__X( "mesh2d::spill_cells: error writing the out-of-core store.\n" );
+   buf.clear();
+}
+
+void
+mesh2d::flush_spill()
+{
+   write_spill( spill_nodes_buf, spill_nodes_file );
+   write_spill( spill_cells_buf, spill_cells_file );
+   write_spill( spill_faces_buf, spill_faces_file );
+}
+
+void
+mesh2d::spill_cells()
+{
+   //
+   // A good cell without bad neighbours is never touched again. Its
+   // neighbours are pointed to spill_cell, which the point location sees
+   // as a boundary and the cavity searches never enter. A node of a spilled
+   // cell is written when no cell in memory uses it: the back mesh keeps the
+   // boundary nodes, so the bulk allocated nodes are never deleted.
+   //
+   cell2d_set::iterator itc;
+   node2d_list::iterator itn;
+   spill_node2d rn;
+   spill_cell2d rc;
+   spill_face2d rf;
+   cell2d *c;
+   node2d *nd;
+   face2d *f;
+   unsigned spilled, stamp;
+   int i;
+
+   spilled = next_epoch();
+
+   for( itc = mesh_cells.begin() ; itc != mesh_cells.end() ; )
+   {
+      c = *itc;
+      itc++;      // c may be erased
+
+      for( i = 0 ; i < 3 ; i++ )
+      {
+         f = c->face[i].adj;
+         if( f != 0 && f->cell->bad )
+            break;
+      }
+      if( i < 3 )
+         continue;
+
+      rc.node[0] = c->face[2].node->id;
+      rc.node[1] = c->face[1].node->id;
+      rc.node[2] = c->face[0].node->id;
+      spill_cells_buf.push_back( rc );
+      for( i = 0 ; i < 3 ; i++ )
+         c->face[i].node->mark = spilled;
+      spill_num_cells++;
+
+      for( i = 0 ; i < 3 ; i++ )
+      {
+         f = c->face[i].adj;
+         if( f == 0 )
+         {
+            rf.node[0] = c->face[ FAC2D[i][1] ].node->id;
+            rf.node[1] = c->face[ FAC2D[i][0] ].node->id;
+            rf.bc_type = c->face[ FAC2D[i][1] ].node->bc_type & c->face[ FAC2D[i][0] ].node->bc_type;
+            spill_faces_buf.push_back( rf );
+            spill_num_faces++;
+         }
+         else if( f->cell != &spill_cell )
+            f->adj = spill_cell.face+0;
+      }
+
+      mesh_cells.erase( c );
+      delete c;
+
+      if( (int) spill_cells_buf.size() >= spill_chunk )
+         write_spill( spill_cells_buf, spill_cells_file );
+      if( (int) spill_faces_buf.size() >= spill_chunk )
+         write_spill( spill_faces_buf, spill_faces_file );
+   }
+
+   stamp = next_epoch();
+   for( itc = bad_cells.begin() ; itc != bad_cells.end() ; itc++ )
+      for( i = 0 ; i < 3 ; i++ )
+         (*itc)->face[i].node->mark = stamp;
+   for( itc = mesh_cells.begin() ; itc != mesh_cells.end() ; itc++ )
+      for( i = 0 ; i < 3 ; i++ )
+         (*itc)->face[i].node->mark = stamp;
+   for( itc = back_mesh.begin() ; itc != back_mesh.end() ; itc++ )
+      for( i = 0 ; i < 3 ; i++ )
+         (*itc)->face[i].node->mark = stamp;
+
+   for( itn = mesh_nodes.begin() ; itn != mesh_nodes.end() ; )
    {
-      ite = frontal_wait->begin();
-      frontal_edges.insert( *ite );
-      frontal_wait->erase( ite );
+      nd = *itn;
+      if( nd->mark != spilled )
+      {
+         itn++;
+         continue;
+      }
+      rn.id = nd->id;
+      rn.x  = nd->p.x;
+      rn.y  = nd->p.y;
+      spill_nodes_buf.push_back( rn );
+      spill_num_nodes++;
+
+      itn = mesh_nodes.erase( itn );
+      delete nd;
+
+      if( (int) spill_nodes_buf.size() >= spill_chunk )
+         write_spill( spill_nodes_buf, spill_nodes_file );
    }
 }
 
@@ -793,7 +1476,7 @@ mesh2d::is_implicit( cell2d *c, int type )
 {
    double t0x, t0y, t1x, t1y, t2x, t2y;
    double nt0, nt1, nt2, h0, h1, h2;
-   double dot01, dot12, dot20, mndot;
+   double dot01, dot12, dot20, mndot, m[3];
 
    face2d *f;
    int i, flag = 0;
@@ -817,6 +1500,21 @@ mesh2d::is_implicit( cell2d *c, int type )
    dot01 = -( t0x * t1x + t0y * t1y );
    dot12 = -( t1x * t2x + t1y * t2y );
    dot20 = -( t2x * t0x + t2y * t0y );
+   //
+   // with a metric the lengths and angles are measured in the cell metric
+   //
+   if( cell_metric( c, m ) )
+   {
+      nt0 = metric_norm( m, t0x, t0y );
+      nt1 = metric_norm( m, t1x, t1y );
+      nt2 = metric_norm( m, t2x, t2y );
+
+      h0 = h1 = h2 = impl_factor;
+
+      dot01 = -( m[0] * t0x * t1x + m[1] * ( t0x * t1y + t0y * t1x ) + m[2] * t0y * t1y );
+      dot12 = -( m[0] * t1x * t2x + m[1] * ( t1x * t2y + t1y * t2x ) + m[2] * t1y * t2y );
+      dot20 = -( m[0] * t2x * t0x + m[1] * ( t2x * t0y + t2y * t0x ) + m[2] * t2y * t0y );
+   }
    mndot = min( dot01, min( dot12, dot20 ) );
 
    for( i = 0 ; i < 3 ; i++ )
@@ -849,32 +1547,62 @@ mesh2d::is_implicit( cell2d *c, int type )
 void
 mesh2d::implicit_cells()
 {
-   cell2d_set::iterator it, itd;
+   //
+   // Only a bad cell with a good neighbour (or a boundary face) can be
+   // implicit, and it may change only when a neighbour becomes good. The
+   // candidates keep the bad_cells order and the neighbours inserted ahead
+   // of the iterator are still visited in the same sweep, as before.
+   // A cell the last call left bad cannot become implicit before one of
+   // its neighbours does, so the seeds are the frontal cells created since
+   // then: the head of bad_cells, sorted by decreasing id.
+   //
+   cell2d_set::iterator it;
    cell2d *c;
+   face2d *f;
    bool changed = true;
-   frontal_edges.clear();
-   int type;
+   int i, type;
+
+   clear_frontal_edges();
+   implicit_cand.clear();
+
+   for( it = bad_cells.begin() ; it != bad_cells.end() && (*it)->id > implicit_id ; it++ )
+   {
+      c = *it;
+      if( is_frontal_face( c->face+0 ) || is_frontal_face( c->face+1 ) ||
+          is_frontal_face( c->face+2 ) )
+         implicit_cand.insert( implicit_cand.end(), c );
+   }
+   implicit_id = cur_cell_id;
 
    while( changed )
    {
       changed = false;
       for( type = 1 ; type <= 3 ; type++ )
       {
-         for( it = bad_cells.begin() ; it != bad_cells.end() ; )
+         for( it = implicit_cand.begin() ; it != implicit_cand.end() ; )
          {
             c = *it;
-            itd = it;   // to erase current position if needed
-            it++;
             if( is_implicit( c, type ) )
             {
-               bad_cells.erase( itd );
+               erase_bad_cell( c );
                c->bad = false;
                mesh_cells.insert( c );
                changed = true;
+
+               for( i = 0 ; i < 3 ; i++ )
+               {
+                  f = c->face[i].adj;
+                  if( f != 0 && f->cell->bad )
+                     implicit_cand.insert( f->cell );
+               }
+               implicit_cand.erase( it++ );   // after the insertions
             }
+            else
+               it++;
          }
       }
    }
+   implicit_cand.clear();
 }
 
 void
@@ -886,6 +1614,7 @@ mesh2d::smooth()
    node2d *nn, *ns, *np;
    int i = 1;
 
+   clear_locate_grid();               // the nodes move
    make_delaunay( &mesh_cells );
    dump_mesh();
    int num = mesh_nodes.size();
@@ -964,17 +1693,29 @@ mesh2d::mesh_generation()
    cell2d_set::iterator itb;
    edge2d_set_addr::iterator ita;
    edge2d *be;
-   cell2d *ins_cell;
-   node2d *new_node;
 
+   int est_nodes, est_cells, est_edges;
    int cycle = 1;
 
    printf( "\nStarting mesh generation\n\n" );
 
-   create_back_mesh();
+   if( back_mesh.empty() )
+   {
+      create_back_mesh();
+      if( metric_func != 0 )           // now in the metric of the cells
+         make_delaunay( &bad_cells );
+   }
+   else                                // given by parallel_generation
+      make_delaunay( &bad_cells );
    dump_back();
 
+   estimate_mesh_size( &est_nodes, &est_cells, &est_edges );
+   bad_array.reserve( est_cells );
+   frontal_sort.reserve( est_edges / 4 );
+   printf( "Expected %i nodes and %i cells\n\n", est_nodes, est_cells );
+
    centroide();
+   implicit_id = 0;
    create_frontal_edges();
 
    while( !frontal_edges.empty() )
@@ -989,19 +1730,7 @@ mesh2d::mesh_generation()
             delete be->new_node;
             continue;
          }
-         //
-         // We delete cells each point inserted. Find again...
-         //
-         new_node = be->new_node;
-         ins_cell = find_bad_cell( be->adj->cell, new_node );
-         if( ins_cell == 0 )
-            THROW__X( "mesh2d::mesh_generation: find_cell failed.\n" );
-         //
-         // create front for FIST and create a new triangle updating fist_front
-         //
-         create_fist_front( ins_cell, new_node );
-         create_new_cell( be, new_node );
-         fist_generation();
+         insert_point( be );
       }
 
       if( make_delaunay( &bad_cells ) ) // should not be needed
@@ -1014,6 +1743,8 @@ mesh2d::mesh_generation()
       }
 
       implicit_cells();
+      if( spill_chunk > 0 )
+         spill_cells();
       create_frontal_edges();
 
       printf( "%s   front number = %4i\n", mov_up, cycle++ );
@@ -1024,9 +1755,11 @@ mesh2d::mesh_generation()
    while( !bad_cells.empty() )
    {
       itb = bad_cells.begin();
+      (*itb)->slot = -1;
       mesh_cells.insert( *itb );
       bad_cells.erase( itb );
    }
+   bad_array.clear();
 
    printf( "Ending mesh generation\n\n" );
    return false;
@@ -1177,4 +1910,106 @@ mesh2d::save_tri6_xda( FILE *stream )
 
 }
 
+void
+mesh2d::get_export_sizes( int *nodes, int *cells, int *bfaces, int *mids )
+{
+   cell2d_set::iterator itc;
+   int i;
+
+   *nodes  = mesh_nodes.size();
+   *cells  = mesh_cells.size();
+   *mids   = mid_nodes.size();
+   *bfaces = 0;
+
+   for( itc = mesh_cells.begin() ; itc != mesh_cells.end() ; itc++ )
+      for( i = 0 ; i < 3 ; i++ )
+         if( (*itc)->face[i].adj == 0 )
+            (*bfaces)++;
+}
+
+void
+mesh2d::export_arrays( mesh2d_arrays& a )
+{
+   //
+   // ids are renumbered: nodes from 0, mid nodes after the nodes and cells
+   // from num_cells down to 1, keeping the mesh_cells ordering valid.
+   // The cell index is then num_cells - id.
+   //
+   node2d_list::iterator itn;
+   cell2d_set::iterator itc;
+   cell2d *cl;
+   node2d *nd;
+   face2d *f;
+   int num_cells, cur_id, ci, nb, i, k;
+
+   num_cells = mesh_cells.size();
+
+   for( itn = mesh_nodes.begin(), cur_id = 0 ; itn != mesh_nodes.end() ; itn++, cur_id++ )
+   {
+      nd = *itn;
+      nd->id = cur_id;
+      if( a.xy )
+      {
+         a.xy[ 2*cur_id+0 ] = nd->p.x;
+         a.xy[ 2*cur_id+1 ] = nd->p.y;
+      }
+      if( a.node_bc )
+         a.node_bc[ cur_id ] = nd->bc_type;
+   }
+
+   for( itn = mid_nodes.begin(), i = 0 ; itn != mid_nodes.end() ; itn++, i++ )
+   {
+      nd = *itn;
+      nd->id = cur_id++;
+      if( a.mid_xy )
+      {
+         a.mid_xy[ 2*i+0 ] = nd->p.x;
+         a.mid_xy[ 2*i+1 ] = nd->p.y;
+      }
+   }
+
+   for( itc = mesh_cells.begin(), cur_id = num_cells ; itc != mesh_cells.end() ; itc++ )
+      (*itc)->id = cur_id--;
+
+   nb = 0;
+   for( itc = mesh_cells.begin() ; itc != mesh_cells.end() ; itc++ )
+   {
+      cl = *itc;
+      ci = num_cells - cl->id;
+
+      for( k = 0 ; k < 3 ; k++ )
+      {
+         f = cl->face + 2 - k;     // counter-clockwise order
+
+         if( a.tri )
+            a.tri[ 3*ci+k ] = f->node->id;
+         if( a.neighbour )
+            a.neighbour[ 3*ci+k ] = ( f->adj ? num_cells - f->adj->cell->id : -1 );
+         if( a.mid )
+            a.mid[ 3*ci+k ] = ( f->mid_node ? f->mid_node->id : -1 );
+      }
+
+      for( i = 0 ; i < 3 ; i++ )
+      {
+         f = cl->face + i;
+         if( f->adj != 0 )
+            continue;
+
+         node2d* nd_adj_1 = cl->face[ FAC2D[i][0] ].node;
+         node2d* nd_adj_0 = cl->face[ FAC2D[i][1] ].node;
+
+         if( a.bface )
+         {
+            a.bface[ 2*nb+0 ] = nd_adj_0->id;
+            a.bface[ 2*nb+1 ] = nd_adj_1->id;
+         }
+         if( a.bface_cell )
+            a.bface_cell[ nb ] = ci;
+         if( a.bface_type )
+            a.bface_type[ nb ] = nd_adj_0->bc_type & nd_adj_1->bc_type;
+         nb++;
+      }
+   }
+}
+
 //***EOF************************************************************************
@@ -0,0 +1,755 @@
+/***************************************************************************
+                            mesh generation code
+                            --------------------
+    parallel mesh generation
+    copyright               : (C) 2001 by Joao Carlos de Campos Henriques
+    email                   : jcch@popsrv.ist.utl.pt
+ ***************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <algorithm>
+#include <map>
+
+#include "t_mesh2d.h"
+#include "t_mesh2d_thread.h"
+
+using namespace mesh_2d;
+
+/***********************************************************************
+   domain decomposition
+ ***********************************************************************/
+
+struct part_cell
+{
+   double   x, y;          // centroid
+   double   w;             // expected number of cells
+   int      index;         // position in bad_array
+};
+
+struct smaller_part_x
+{
+   bool operator () ( const part_cell& a, const part_cell& b ) const
+   {
+      return( a.x < b.x || ( a.x == b.x && a.index < b.index ) );
+   }
+};
+
+struct smaller_part_y
+{
+   bool operator () ( const part_cell& a, const part_cell& b ) const
+   {
+      return( a.y < b.y || ( a.y == b.y && a.index < b.index ) );
+   }
+};
+
+//
+// recursive coordinate bisection of pc[lo,hi) in k parts, numbered from p0
+//
+static void
+bisect_cells( vector<part_cell>& pc, int lo, int hi, int p0, int k, vector<int>& label )
+{
+   double xmin, xmax, ymin, ymax, total, sum;
+   int i, mid, k0;
+
+   if( k == 1 || hi - lo < 2 )
+   {
+      for( i = lo ; i < hi ; i++ )
+         label[ pc[i].index ] = p0;
+      return;
+   }
+
+   xmin = xmax = pc[lo].x;
+   ymin = ymax = pc[lo].y;
+   total = 0.0;
+   for( i = lo ; i < hi ; i++ )
+   {
+      xmin = min( xmin, pc[i].x );
+      xmax = max( xmax, pc[i].x );
+      ymin = min( ymin, pc[i].y );
+      ymax = max( ymax, pc[i].y );
+      total += pc[i].w;
+   }
+
+   if( xmax - xmin >= ymax - ymin )
+      sort( pc.begin() + lo, pc.begin() + hi, smaller_part_x() );
+   else
+      sort( pc.begin() + lo, pc.begin() + hi, smaller_part_y() );
+
+   k0 = k / 2;
+   sum = 0.0;
+   for( mid = lo ; mid < hi - 1 && sum + 0.5 * pc[mid].w < total * k0 / k ; mid++ )
+      sum += pc[mid].w;
+   if( mid == lo )
+      mid++;
+
+   bisect_cells( pc, lo, mid, p0, k0, label );
+   bisect_cells( pc, mid, hi, p0 + k0, k - k0, label );
+}
+
+//
+// connected pieces of the labelled cells, returns the number of pieces
+//
+static int
+label_pieces( vector<cell2d*>& cells, vector<int>& label, vector<int>& piece )
+{
+   vector<int> stack;
+   face2d *f;
+   int i, j, k, num = 0;
+
+   piece.assign( cells.size(), -1 );
+   for( i = 0 ; i < (int) cells.size() ; i++ )
+   {
+      if( piece[i] >= 0 )
+         continue;
+      piece[i] = num;
+      stack.push_back( i );
+      while( !stack.empty() )
+      {
+         j = stack.back();
+         stack.pop_back();
+         for( k = 0 ; k < 3 ; k++ )
+         {
+            f = cells[j]->face[k].adj;
+            if( f != 0 && piece[ f->cell->slot ] < 0 && label[ f->cell->slot ] == label[j] )
+            {
+               piece[ f->cell->slot ] = num;
+               stack.push_back( f->cell->slot );
+            }
+         }
+      }
+      num++;
+   }
+   return num;
+}
+
+//
+// The bisection of the boundary triangulation leaves fragments, the pieces
+// of a part other than its heaviest one. Each fragment goes to the main
+// piece it shares most faces with, until no fragment touches a main piece.
+// Returns the number of pieces.
+//
+static int
+merge_fragments( vector<cell2d*>& cells, vector<double>& w, int parts,
+                 vector<int>& label, vector<int>& piece )
+{
+   vector<double> pw;
+   vector<int> pl, main_piece, dest, shared;
+   face2d *f;
+   int i, j, p, q, num;
+   bool merged;
+
+   do {
+      num = label_pieces( cells, label, piece );
+
+      pw.assign( num, 0.0 );
+      pl.assign( num, 0 );
+      for( i = 0 ; i < (int) cells.size() ; i++ )
+      {
+         pw[ piece[i] ] += w[i];
+         pl[ piece[i] ] = label[i];
+      }
+      main_piece.assign( parts, -1 );
+      for( p = 0 ; p < num ; p++ )
+         if( main_piece[ pl[p] ] < 0 || pw[p] > pw[ main_piece[ pl[p] ] ] )
+            main_piece[ pl[p] ] = p;
+      //
+      // faces of each fragment with the main piece of each part
+      //
+      shared.assign( num * parts, 0 );
+      for( i = 0 ; i < (int) cells.size() ; i++ )
+      {
+         if( main_piece[ label[i] ] == piece[i] )
+            continue;
+         for( j = 0 ; j < 3 ; j++ )
+         {
+            f = cells[i]->face[j].adj;
+            if( f != 0 && main_piece[ label[ f->cell->slot ] ] == piece[ f->cell->slot ] )
+               shared[ piece[i] * parts + label[ f->cell->slot ] ]++;
+         }
+      }
+
+      dest.assign( num, -1 );
+      merged = false;
+      for( p = 0 ; p < num ; p++ )
+         for( q = 0 ; q < parts ; q++ )
+            if( shared[ p * parts + q ] > 0 &&
+                ( dest[p] < 0 || shared[ p * parts + q ] > shared[ p * parts + dest[p] ] ) )
+            {
+               dest[p] = q;
+               merged = true;
+            }
+
+      for( i = 0 ; i < (int) cells.size() ; i++ )
+         if( dest[ piece[i] ] >= 0 )
+            label[i] = dest[ piece[i] ];
+   } while( merged );
+
+   return num;
+}
+
+//
+// integral of 1/h along a segment of length len where h is linear from h0
+// to h1
+//
+static double
+cut_integral( double len, double h0, double h1 )
+{
+   if( fabs( h1 - h0 ) > 1E-12 * ( h0 + h1 ) )
+      return( len * log( h1 / h0 ) / ( h1 - h0 ) );
+   return( 2.0 * len / ( h0 + h1 ) );
+}
+
+//
+// the position in [0,1] along the same segment where the integral is J,
+// and h there
+//
+static double
+cut_position( double len, double h0, double h1, double J, double& h )
+{
+   double s;
+
+   if( fabs( h1 - h0 ) > 1E-12 * ( h0 + h1 ) )
+   {
+      h = h0 * exp( J * ( h1 - h0 ) / len );
+      return( ( h - h0 ) / ( h1 - h0 ) );
+   }
+   s = 0.5 * J * ( h0 + h1 ) / len;
+   h = h0 + s * ( h1 - h0 );
+   return s;
+}
+
+//
+// the rows of new_point are h / ( sin60 - g / 2 ) apart, instead of
+// h / sin60 without a gradient; at most twice as far
+//
+static double
+growth( double g )
+{
+   static const double sin60 = 0.5 * sqrt( 3.0 );
+
+   return( sin60 / max( 0.5 * sin60, sin60 - 0.5 * g ) );
+}
+
+bool
+mesh2d::parallel_generation( int parts, int threads )
+{
+   typedef map<pair<int,int>, vector<node2d*> > cut_map;
+   typedef map<pair<int,int>, face2d*> face_map;
+
+   vector<part_cell> pc;
+   vector<double> weight;
+   vector<int> label, piece;
+   vector<cell2d*> cells, back;
+   vector< vector<node2d*> > twins;
+   vector<mesh2d*> subs;
+   cut_map cuts;
+   face_map bfaces;
+   cell2d_set::iterator itb, itp;
+
+   cell2d *c;
+   face2d *f;
+   node2d *u, *v, *nd;
+   double ha, hb, len, t, s, h, q;
+   int i, j, k, n, num_pieces;
+   bool merged;
+
+   if( parts < 2 )
+      return mesh_generation();
+
+   printf( "\nStarting parallel mesh generation\n\n" );
+
+   create_back_mesh();
+   //
+   // cells of the boundary triangulation weighted by the expected number
+   // of cells, as in estimate_mesh_size
+   //
+   cells = bad_array;
+   pc.resize( cells.size() );
+   label.resize( cells.size() );
+   for( i = 0 ; i < (int) cells.size() ; i++ )
+   {
+      c = cells[i];
+      c->slot = i;
+      q = 0.0;
+      for( j = 0 ; j < 3 ; j++ )
+         q += 1.0 / sqr( 0.5 * ( succ_node( c->face+j )->h + pred_node( c->face+j )->h ) );
+      pc[i].x = ( c->face[0].node->p.x + c->face[1].node->p.x + c->face[2].node->p.x ) / 3.0;
+      pc[i].y = ( c->face[0].node->p.y + c->face[1].node->p.y + c->face[2].node->p.y ) / 3.0;
+      pc[i].w = cell_area( c ) * q / 3.0;
+      pc[i].index = i;
+   }
+   weight.resize( cells.size() );
+   for( i = 0 ; i < (int) cells.size() ; i++ )
+      weight[i] = pc[i].w;
+   bisect_cells( pc, 0, pc.size(), 0, parts, label );
+   merge_fragments( cells, weight, parts, label, piece );
+   //
+   // FIST needs simple front loops: a piece touching itself at a node is
+   // merged with a neighbour part until no such node is left
+   //
+   do {
+      map<pair<int,int>, int> out;
+      map<pair<int,int>, int>::iterator it;
+
+      merged = false;
+      num_pieces = label_pieces( cells, label, piece );
+
+      for( i = 0 ; i < (int) cells.size() ; i++ )
+         for( j = 0 ; j < 3 ; j++ )
+         {
+            f = cells[i]->face[j].adj;
+            if( f == 0 || piece[ f->cell->slot ] != piece[i] )
+               out[ make_pair( piece[i], succ_node( cells[i]->face+j )->id ) ]++;
+         }
+
+      for( it = out.begin() ; it != out.end() && !merged ; it++ )
+      {
+         if( it->second < 2 )
+            continue;
+         for( i = 0 ; i < (int) cells.size() && !merged ; i++ )
+         {
+            if( piece[i] != it->first.first )
+               continue;
+            for( j = 0 ; j < 3 && !merged ; j++ )
+            {
+               f = cells[i]->face[j].adj;
+               if( f != 0 && piece[ f->cell->slot ] != piece[i] &&
+                   succ_node( cells[i]->face+j )->id == it->first.second )
+               {
+                  for( k = 0 ; k < (int) cells.size() ; k++ )
+                     if( piece[k] == piece[i] )
+                        label[k] = label[ f->cell->slot ];
+                  merged = true;
+               }
+            }
+         }
+      }
+   } while( merged );
+   //
+   // the background cell of each boundary cell, the same ids in the same
+   // order
+   //
+   back.resize( cells.size() );
+   for( itb = back_mesh.begin(), itp = bad_cells.begin() ; itb != back_mesh.end() ; itb++, itp++ )
+   {
+      if( (*itb)->id != (*itp)->id )
+         THROW__X( "mesh2d::parallel_generation: back != cell mesh.\n" );
+      (*itb)->slot = (*itp)->slot;
+      back[ (*itp)->slot ] = *itb;
+   }
+   //
+   // discretize the cut edges with the spacing the pieces see on both
+   // sides, the smaller of the two interpolated planes. Each is linear
+   // along the edge, their minimum has a kink at most. The nodes are
+   // equally spaced in the integral of 1/h, scaled on each side of the
+   // kink by the growth of the rows in new_point, sin60 / ( sin60 - g / 2 )
+   // for the gradient g along the edge.
+   //
+   for( i = 0 ; i < (int) cells.size() ; i++ )
+      for( j = 0 ; j < 3 ; j++ )
+      {
+         f = cells[i]->face[j].adj;
+         if( f == 0 || piece[ f->cell->slot ] == piece[i] )
+            continue;
+
+         u = succ_node( cells[i]->face+j );
+         v = pred_node( cells[i]->face+j );
+         if( u->id > v->id )
+            swap( u, v );
+         if( cuts.find( edge_key( u, v ) ) != cuts.end() )
+            continue;
+
+         vector<node2d*>& pts = cuts[ edge_key( u, v ) ];
+         cell2d *ca = back[i], *cb = back[ f->cell->slot ];
+         double ua = interpolate( ca, u ), va = interpolate( ca, v );
+         double ub = interpolate( cb, u ), vb = interpolate( cb, v );
+         double sk, hk, I0, I1, g0, g1;
+
+         ha = min( ua, ub );
+         hb = min( va, vb );
+         sk = ( ( ua - ub ) * ( va - vb ) < 0.0 ? ( ua - ub ) / ( ( ua - ub ) - ( va - vb ) ) : 1.0 );
+         hk = min( ua + sk * ( va - ua ), ub + sk * ( vb - ub ) );
+         len = norm( v->p.x - u->p.x, v->p.y - u->p.y );
+         g0  = ( sk > 0.0 ? growth( fabs( hk - ha ) / ( sk * len ) ) : 1.0 );
+         g1  = ( sk < 1.0 ? growth( fabs( hb - hk ) / ( ( 1.0 - sk ) * len ) ) : 1.0 );
+         I0  = cut_integral( sk * len, ha, hk ) / g0;
+         I1  = cut_integral( ( 1.0 - sk ) * len, hk, hb ) / g1;
+         n   = max( 1, (int) floor( I0 + I1 + 0.5 ) );
+
+         for( k = 1 ; k < n ; k++ )
+         {
+            t = k * ( I0 + I1 ) / n;
+            if( t <= I0 )
+               s = sk * cut_position( sk * len, ha, hk, t * g0, h );
+            else
+               s = sk + ( 1.0 - sk ) * cut_position( ( 1.0 - sk ) * len, hk, hb, ( t - I0 ) * g1, h );
+
+            nd = node_alloc( ++cur_node_id );
+            nd->p.x = u->p.x + s * ( v->p.x - u->p.x );
+            nd->p.y = u->p.y + s * ( v->p.y - u->p.y );
+            nd->h = h;
+            if( metric_func != 0 )
+               metric_at( find_back_cell( nd ), nd->p.x, nd->p.y, nd->m );
+            mesh_nodes.push_back( nd );
+            pts.push_back( nd );
+         }
+      }
+   //
+   // front loops of each piece, following the cell orientation
+   //
+   subs.resize( num_pieces );
+   twins.resize( num_pieces );
+
+   for( k = 0 ; k < num_pieces ; k++ )
+   {
+      map<int, face2d*> out;
+      map<int, face2d*>::iterator it;
+      vector<double> x, y, param;
+      vector<int> bc_type, bc_index, bc_surface;
+
+      for( i = 0 ; i < (int) cells.size() ; i++ )
+         if( piece[i] == k )
+            for( j = 0 ; j < 3 ; j++ )
+            {
+               f = cells[i]->face[j].adj;
+               if( f == 0 || piece[ f->cell->slot ] != k )
+                  out[ succ_node( cells[i]->face+j )->id ] = cells[i]->face+j;
+            }
+
+      subs[k] = new mesh2d( node_alloc, cell_alloc, link_alloc, edge_alloc );
+      subs[k]->set_dumping( false );
+      subs[k]->star_insertion = star_insertion;
+      subs[k]->size_func = size_func;
+      subs[k]->size_data = size_data;
+      subs[k]->size_sources = size_sources;
+      subs[k]->back_grid = back_grid;
+      subs[k]->metric_func = metric_func;
+      subs[k]->metric_data = metric_data;
+
+      while( !out.empty() )
+      {
+         vector<node2d*> loop;
+         int first = out.begin()->first;
+
+         it = out.begin();
+         do {
+            f = it->second;
+            out.erase( it );
+            u = succ_node( f );
+            v = pred_node( f );
+            loop.push_back( u );
+
+            cut_map::iterator itc = cuts.find( edge_key( u, v ) );
+            if( f->adj != 0 && itc != cuts.end() )
+            {
+               vector<node2d*>& pts = itc->second;
+               if( u->id < v->id )
+                  loop.insert( loop.end(), pts.begin(), pts.end() );
+               else
+                  loop.insert( loop.end(), pts.rbegin(), pts.rend() );
+            }
+            it = out.find( v->id );
+         } while( v->id != first && it != out.end() );
+
+         if( v->id != first )
+            THROW__X( "mesh2d::parallel_generation: open front loop.\n" );
+
+         n = loop.size();
+         x.resize( n ); y.resize( n ); param.resize( n );
+         bc_type.resize( n ); bc_index.resize( n ); bc_surface.resize( n );
+         for( i = 0 ; i < n ; i++ )
+         {
+            x[i] = loop[i]->p.x;
+            y[i] = loop[i]->p.y;
+            param[i] = loop[i]->param;
+            bc_type[i] = loop[i]->bc_type;
+            bc_index[i] = loop[i]->bc_index;
+            bc_surface[i] = loop[i]->bc_surface;
+         }
+         subs[k]->add_front( n, &x[0], &y[0], &bc_type[0], &bc_index[0], &bc_surface[0], &param[0] );
+         twins[k].insert( twins[k].end(), loop.begin(), loop.end() );
+      }
+      //
+      // keep the spacing of the whole domain at the front nodes
+      //
+      node2d_list::iterator itn = subs[k]->mesh_nodes.begin();
+      for( i = 0 ; i < (int) twins[k].size() ; i++, itn++ )
+      {
+         (*itn)->h = twins[k][i]->h;
+         (*itn)->m[0] = twins[k][i]->m[0];
+         (*itn)->m[1] = twins[k][i]->m[1];
+         (*itn)->m[2] = twins[k][i]->m[2];
+      }
+   }
+
+   //
+   // each piece interpolates the spacing on its own part of the background
+   // mesh, the same linear field as in the serial generation
+   //
+   {
+      map<cell2d*, cell2d*> back_twin;
+      cell2d *cb;
+
+      for( i = 0 ; i < (int) cells.size() ; i++ )
+      {
+         cb = back[i];
+         c = cell_alloc( cb->id );
+         for( j = 0 ; j < 3 ; j++ )
+            c->face[j].node = cb->face[j].node;
+         c->dh_dx = cb->dh_dx;
+         c->dh_dy = cb->dh_dy;
+         c->hp[0] = cb->hp[0];
+         c->hp[1] = cb->hp[1];
+         c->hp[2] = cb->hp[2];
+         subs[ piece[i] ]->back_mesh.insert( c );
+         back_twin[ cb ] = c;
+      }
+      for( i = 0 ; i < (int) cells.size() ; i++ )
+      {
+         cb = back[i];
+         for( j = 0 ; j < 3 ; j++ )
+         {
+            f = cb->face[j].adj;
+            if( f != 0 && piece[ f->cell->slot ] == piece[i] )
+               back_twin[ cb ]->face[j].adj = back_twin[ f->cell ]->face + f->id;
+         }
+      }
+   }
+
+   n = 0;
+   for( cut_map::iterator itc = cuts.begin() ; itc != cuts.end() ; itc++ )
+      n += itc->second.size();
+   printf( "%i parts, %i pieces, %i cut nodes\n\n", parts, num_pieces, n );
+   //
+   // the boundary triangulation is replaced by the pieces
+   //
+   for( i = 0 ; i < (int) cells.size() ; i++ )
+      delete cells[i];
+   bad_cells.clear();
+   bad_array.clear();
+   //
+   // mesh the pieces, biggest first
+   //
+   threads = worker_threads( threads );
+
+   vector<pair<int,int> > order( num_pieces );
+   for( k = 0 ; k < num_pieces ; k++ )
+      order[k] = make_pair( -(int) twins[k].size(), k );
+   sort( order.begin(), order.end() );
+
+   parallel_for( threads, num_pieces, 1, [&]( int w ) {
+      mesh2d *sm = subs[ order[w].second ];
+      sm->fist_generation();
+      sm->mesh_generation();
+   } );
+   //
+   // stitch: the front nodes of a piece are replaced by their twins, the
+   // other nodes and the cells move to this mesh with new ids and the
+   // faces left open on both sides of a cut are attached
+   //
+   for( k = 0 ; k < num_pieces ; k++ )
+   {
+      mesh2d *sm = subs[k];
+      map<node2d*, node2d*> twin;
+      node2d_list::iterator itn;
+      cell2d_set::iterator itc;
+      face_map::iterator itf;
+
+      itn = sm->mesh_nodes.begin();
+      for( i = 0 ; i < (int) twins[k].size() ; i++, itn++ )
+         twin[ *itn ] = twins[k][i];
+      for( ; itn != sm->mesh_nodes.end() ; itn++ )
+      {
+         (*itn)->id = ++cur_node_id;
+         mesh_nodes.push_back( *itn );
+      }
+
+      for( itc = sm->mesh_cells.begin() ; itc != sm->mesh_cells.end() ; itc++ )
+      {
+         c = *itc;
+         for( j = 0 ; j < 3 ; j++ )
+         {
+            map<node2d*, node2d*>::iterator itw = twin.find( c->face[j].node );
+            if( itw != twin.end() )
+               c->face[j].node = itw->second;
+         }
+      }
+
+      for( itc = sm->mesh_cells.begin() ; itc != sm->mesh_cells.end() ; itc++ )
+      {
+         c = *itc;
+         c->id = ++cur_cell_id;
+         c->slot = -1;
+         mesh_cells.insert( c );
+
+         for( j = 0 ; j < 3 ; j++ )
+         {
+            f = c->face+j;
+            if( f->adj != 0 )
+               continue;
+            pair<int,int> key = edge_key( succ_node( f ), pred_node( f ) );
+            itf = bfaces.find( key );
+            if( itf == bfaces.end() )
+               bfaces[ key ] = f;
+            else
+            {
+               attach_faces( itf->second, f );
+               bfaces.erase( itf );
+            }
+         }
+      }
+
+      for( itc = sm->back_mesh.begin() ; itc != sm->back_mesh.end() ; itc++ )
+         delete *itc;
+      sm->back_mesh.clear();
+      sm->mesh_cells.clear();
+      sm->mesh_nodes.clear();
+      delete sm;
+   }
+
+   vector<node2d*> seeds;
+   for( cut_map::iterator itk = cuts.begin() ; itk != cuts.end() ; itk++ )
+      seeds.insert( seeds.end(), itk->second.begin(), itk->second.end() );
+   smooth_interface( seeds );
+
+   printf( "Ending parallel mesh generation\n\n" );
+   return false;
+}
+
+//
+// rings of cells around the cut nodes in the band of smooth_interface
+//
+static const int interface_rings = 3;
+
+struct smaller_star
+{
+   bool operator () ( const pair<node2d*, cell2d*>& a, const pair<node2d*, cell2d*>& b ) const
+   {
+      return( a.first->id < b.first->id || ( a.first->id == b.first->id && a.second->id < b.second->id ) );
+   }
+};
+
+//
+// The pieces are meshed up to the cut nodes from both sides, each to its
+// own front. The band of interface_rings rings of cells around the cut
+// nodes is flipped to Delaunay, the inner nodes of the band are moved
+// to the mean of their neighbours when that does not lower the worst
+// quality of their cells, and the band is flipped again. The moves are
+// isotropic, with a metric the band is only flipped.
+//
+void
+mesh2d::smooth_interface( vector<node2d*>& seeds )
+{
+   vector<pair<node2d*, cell2d*> > star;
+   vector<cell2d*> band;
+   vector<node2d*> inner;
+   cell2d_set::iterator itc;
+   cell2d *c;
+   node2d *nn;
+   p2d q;
+   double x, y, qmin, qnew;
+   unsigned stamp;
+   int i, j, k, a, b, sweep;
+   bool ok;
+
+   if( seeds.empty() )
+      return;
+   //
+   // the cut nodes, then the nodes of their cells, ring by ring
+   //
+   stamp = next_epoch();
+   for( i = 0 ; i < (int) seeds.size() ; i++ )
+      seeds[i]->mark = stamp;
+   for( k = 0 ; k < interface_rings ; k++ )
+   {
+      inner.clear();
+      for( itc = mesh_cells.begin() ; itc != mesh_cells.end() ; itc++ )
+      {
+         c = *itc;
+         if( c->face[0].node->mark == stamp || c->face[1].node->mark == stamp ||
+             c->face[2].node->mark == stamp )
+            for( i = 0 ; i < 3 ; i++ )
+               inner.push_back( c->face[i].node );
+      }
+      for( i = 0 ; i < (int) inner.size() ; i++ )
+         inner[i]->mark = stamp;
+   }
+   //
+   // the flips change the cells of the nodes, the band is taken again
+   //
+   for( k = 0 ; k < 2 ; k++ )
+   {
+      band.clear();
+      for( itc = mesh_cells.begin() ; itc != mesh_cells.end() ; itc++ )
+      {
+         c = *itc;
+         if( c->face[0].node->mark == stamp || c->face[1].node->mark == stamp ||
+             c->face[2].node->mark == stamp )
+            band.push_back( c );
+      }
+      if( k == 0 )
+         for( i = 0 ; i < (int) band.size() ; i++ )
+            for( j = 0 ; j < 3 ; j++ )
+               green_sibson( band[i]->face+j );
+   }
+   if( metric_func != 0 )
+      return;
+   clear_locate_grid();               // the nodes move
+   //
+   // the cells of each inner node, the band has them all
+   //
+   for( i = 0 ; i < (int) band.size() ; i++ )
+      for( j = 0 ; j < 3 ; j++ )
+      {
+         nn = band[i]->face[j].node;
+         if( nn->mark == stamp && nn->bc_type == 0 )
+            star.push_back( make_pair( nn, band[i] ) );
+      }
+   sort( star.begin(), star.end(), smaller_star() );
+
+   for( sweep = 0 ; sweep < 2 ; sweep++ )
+      for( a = 0 ; a < (int) star.size() ; a = b )
+      {
+         nn = star[a].first;
+         for( b = a ; b < (int) star.size() && star[b].first == nn ; b++ );
+
+         x = y = 0.0;
+         qmin = 1.0;
+         for( k = a ; k < b ; k++ )
+         {
+            c = star[k].second;
+            for( j = 0 ; j < 3 ; j++ )
+            {
+               x += c->face[j].node->p.x;
+               y += c->face[j].node->p.y;
+            }
+            qmin = min( qmin, cell_quality( c ) );
+         }
+         q = nn->p;
+         nn->p.x = ( x - ( b - a ) * q.x ) / ( 2 * ( b - a ) );
+         nn->p.y = ( y - ( b - a ) * q.y ) / ( 2 * ( b - a ) );
+
+         ok = true;
+         for( k = a ; k < b && ok ; k++ )
+         {
+            qnew = cell_quality( star[k].second );
+            ok = ( qnew > 0.0 && ( qnew >= qmin || qnew > 0.9 ) );
+         }
+         if( !ok )
+         {
+            nn->p = q;
+            continue;
+         }
+         for( k = a ; k < b ; k++ )
+            circun_circle( star[k].second );
+      }
+
+   for( i = 0 ; i < (int) band.size() ; i++ )
+      for( j = 0 ; j < 3 ; j++ )
+         green_sibson( band[i]->face+j );
+}
+
+//***EOF************************************************************************
@@ -0,0 +1,399 @@
+/***************************************************************************
+                            mesh generation code
+                            --------------------
+    partitioning of a generated mesh
+    copyright               : (C) 2001 by Joao Carlos de Campos Henriques
+    email                   : jcch@popsrv.ist.utl.pt
+ ***************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <algorithm>
+
+#include "t_mesh2d.h"
+#include "t_mesh2d_thread.h"
+
+using namespace mesh_2d;
+
+static const int    partition_block     = 4096;   // cells handled in a row by a worker
+static const int    partition_passes    = 8;      // greedy boundary passes
+//
+// a part may grow this fraction above the mean size in the greedy passes
+//
+static const double partition_imbalance = 0.03;
+
+struct bisect_item
+{
+   double   x, y;          // centroid
+   int      index;         // cell index, as in export_arrays
+};
+
+//
+// cells of index [lo,hi) to cut in k parts, numbered from p0
+//
+struct bisect_range
+{
+   int      lo, hi, p0, k;
+};
+
+//
+// order along the direction ux,uy, the index breaks the ties
+//
+struct smaller_along
+{
+   double ux, uy;
+
+   smaller_along( double _ux, double _uy ) { ux = _ux; uy = _uy; }
+   bool operator () ( const bisect_item& a, const bisect_item& b ) const
+   {
+      double da = a.x * ux + a.y * uy, db = b.x * ux + b.y * uy;
+      return( da < db || ( da == db && a.index < b.index ) );
+   }
+};
+
+//
+// One cut of the range r in r0 and r1, with sizes in the ratio of their
+// numbers of parts. The cut is normal to the longer side of the bounding
+// box or, inertial, to the principal axis of the centroids; nth_element
+// puts the cells on their side without sorting them.
+//
+static void
+bisect_split( vector<bisect_item>& items, const bisect_range& r, bool inertial,
+              bisect_range& r0, bisect_range& r1 )
+{
+   double xmin, xmax, ymin, ymax, mx, my, sxx, sxy, syy, dx, dy, angle, ux, uy;
+   int i, mid, k0, n = r.hi - r.lo;
+
+   if( inertial )
+   {
+      mx = my = 0.0;
+      for( i = r.lo ; i < r.hi ; i++ )
+      {
+         mx += items[i].x;
+         my += items[i].y;
+      }
+      mx /= n;
+      my /= n;
+      sxx = sxy = syy = 0.0;
+      for( i = r.lo ; i < r.hi ; i++ )
+      {
+         dx = items[i].x - mx;
+         dy = items[i].y - my;
+         sxx += dx * dx;
+         sxy += dx * dy;
+         syy += dy * dy;
+      }
+      angle = 0.5 * atan2( 2.0 * sxy, sxx - syy );
+      ux = cos( angle );
+      uy = sin( angle );
+   }
+   else
+   {
+      xmin = xmax = items[r.lo].x;
+      ymin = ymax = items[r.lo].y;
+      for( i = r.lo ; i < r.hi ; i++ )
+      {
+         xmin = min( xmin, items[i].x );
+         xmax = max( xmax, items[i].x );
+         ymin = min( ymin, items[i].y );
+         ymax = max( ymax, items[i].y );
+      }
+      ux = ( xmax - xmin >= ymax - ymin ? 1.0 : 0.0 );
+      uy = 1.0 - ux;
+   }
+
+   k0 = r.k / 2;
+   mid = r.lo + (int) ( (long long) n * k0 / r.k );
+   nth_element( items.begin() + r.lo, items.begin() + mid, items.begin() + r.hi,
+                smaller_along( ux, uy ) );
+
+   r0.lo = r.lo;
+   r0.hi = mid;
+   r0.p0 = r.p0;
+   r0.k  = k0;
+   r1.lo = mid;
+   r1.hi = r.hi;
+   r1.p0 = r.p0 + k0;
+   r1.k  = r.k - k0;
+}
+
+//
+// Greedy boundary passes on the dual graph: a cell goes to the part of
+// its neighbours when it has more of them there than in its own part and
+// the sizes stay within partition_imbalance. Returns the number of moves.
+//
+static int
+improve_partition( vector<cell2d*>& cells, int parts, int *part )
+{
+   vector<int> size( parts, 0 );
+   face2d *f;
+   int num = cells.size(), max_size, min_size, moved = 0, pass, changed;
+   int i, j, k, p, q, own, best, gain, cnt, nb[3];
+
+   for( i = 0 ; i < num ; i++ )
+      size[ part[i] ]++;
+   max_size = (int) ceil( (double) num / parts * ( 1.0 + partition_imbalance ) );
+   min_size = (int) floor( (double) num / parts * ( 1.0 - partition_imbalance ) );
+
+   for( pass = 0 ; pass < partition_passes ; pass++ )
+   {
+      changed = 0;
+      for( i = 0 ; i < num ; i++ )
+      {
+         p = part[i];
+         for( j = 0, own = 0 ; j < 3 ; j++ )
+         {
+            f = cells[i]->face[j].adj;
+            nb[j] = ( f ? part[ num - f->cell->id ] : -1 );
+            if( nb[j] == p )
+               own++;
+         }
+         if( own >= 2 || size[p] <= min_size )
+            continue;
+         best = -1;
+         gain = 0;
+         for( j = 0 ; j < 3 ; j++ )
+         {
+            q = nb[j];
+            if( q < 0 || q == p || size[q] >= max_size )
+               continue;
+            for( k = 0, cnt = 0 ; k < 3 ; k++ )
+               if( nb[k] == q )
+                  cnt++;
+            if( cnt - own > gain )
+            {
+               gain = cnt - own;
+               best = q;
+            }
+         }
+         if( best < 0 )
+            continue;
+         part[i] = best;
+         size[p]--;
+         size[best]++;
+         changed++;
+      }
+      moved += changed;
+      if( changed == 0 )
+         break;
+   }
+   return moved;
+}
+
+int
+mesh2d::partition( int parts, int *part, bool inertial, bool improve, int threads )
+{
+   vector<bisect_item> items;
+   vector<bisect_range> ranges, next;
+   vector<cell2d*> cells;
+   vector<int> size;
+   cell2d_set::iterator itc;
+   bisect_range r;
+   face2d *f;
+   int num, i, k, moved = 0, cut = 0, largest = 0;
+
+   if( spill_chunk > 0 )
+   {
+      printf( "mesh2d::partition: not available with the out of core storage.\n" );
+      return -1;
+   }
+   num = mesh_cells.size();
+   if( parts < 1 || parts > num )
+   {
+      printf( "mesh2d::partition: %i parts for %i cells.\n", parts, num );
+      return -1;
+   }
+
+   threads = worker_threads( threads );
+   cells.reserve( num );
+   for( itc = mesh_cells.begin(), k = num ; itc != mesh_cells.end() ; itc++ )
+   {
+      (*itc)->id = k--;
+      cells.push_back( *itc );
+   }
+   //
+   // xc,yc are the circumcentres, they may lie out of the cell: the
+   // centroids are used
+   //
+   items.resize( num );
+   parallel_for( threads, num, partition_block, [&]( int q ) {
+      cell2d *c = cells[q];
+      items[q].x = ( c->face[0].node->p.x + c->face[1].node->p.x + c->face[2].node->p.x ) / 3.0;
+      items[q].y = ( c->face[0].node->p.y + c->face[1].node->p.y + c->face[2].node->p.y ) / 3.0;
+      items[q].index = q;
+   } );
+   //
+   // the ranges of a level of the bisection are cut on the workers
+   //
+   r.lo = 0;
+   r.hi = num;
+   r.p0 = 0;
+   r.k  = parts;
+   if( parts > 1 )
+      ranges.push_back( r );
+   else
+      for( i = 0 ; i < num ; i++ )
+         part[i] = 0;
+   while( !ranges.empty() )
+   {
+      next.resize( 2 * ranges.size() );
+      parallel_for( threads, ranges.size(), 1, [&]( int q ) {
+         bisect_split( items, ranges[q], inertial, next[2*q], next[2*q+1] );
+      } );
+      ranges.clear();
+      for( k = 0 ; k < (int) next.size() ; k++ )
+      {
+         if( next[k].k > 1 )
+            ranges.push_back( next[k] );
+         else
+            for( i = next[k].lo ; i < next[k].hi ; i++ )
+               part[ items[i].index ] = next[k].p0;
+      }
+   }
+
+   if( improve && parts > 1 )
+      moved = improve_partition( cells, parts, part );
+
+   size.assign( parts, 0 );
+   for( i = 0 ; i < num ; i++ )
+   {
+      size[ part[i] ]++;
+      for( k = 0 ; k < 3 ; k++ )
+      {
+         f = cells[i]->face[k].adj;
+         if( f != 0 && f->cell->id < cells[i]->id && part[ num - f->cell->id ] != part[i] )
+            cut++;
+      }
+   }
+   for( k = 0 ; k < parts ; k++ )
+      largest = max( largest, size[k] );
+
+   printf( "Partitioning: %i parts, %i cut faces, %i cells moved, largest part %i cells\n",
+           parts, cut, moved, largest );
+   return cut;
+}
+
+bool
+mesh2d::save_partitions( const char *prefix, const int *part, int threads )
+{
+   vector<node2d*> nodes;
+   vector<cell2d*> cells;
+   vector<int> first, order;
+   vector<char> failed;
+   node2d_list::iterator itn;
+   cell2d_set::iterator itc;
+   int num, parts, i, k;
+
+   if( spill_chunk > 0 )
+   {
+      printf( "mesh2d::save_partitions: not available with the out of core storage.\n" );
+      return false;
+   }
+
+   num = mesh_cells.size();
+   for( itc = mesh_cells.begin(), k = num ; itc != mesh_cells.end() ; itc++ )
+   {
+      (*itc)->id = k--;
+      cells.push_back( *itc );
+   }
+   for( itn = mesh_nodes.begin(), k = 0 ; itn != mesh_nodes.end() ; itn++ )
+   {
+      (*itn)->id = k++;
+      nodes.push_back( *itn );
+   }
+   for( i = 0, parts = 0 ; i < num ; i++ )
+      parts = max( parts, part[i] + 1 );
+   //
+   // the cells of each part, in the mesh order
+   //
+   first.assign( parts + 1, 0 );
+   for( i = 0 ; i < num ; i++ )
+      first[ part[i] + 1 ]++;
+   for( k = 0 ; k < parts ; k++ )
+      first[k+1] += first[k];
+   order.resize( num );
+   {
+      vector<int> fill( first.begin(), first.end() - 1 );
+      for( i = 0 ; i < num ; i++ )
+         order[ fill[ part[i] ]++ ] = i;
+   }
+
+   failed.assign( parts, 0 );
+   parallel_for( worker_threads( threads ), parts, 1, [&]( int p ) {
+      vector<int> used;
+      char name[1024];
+      FILE *stream;
+      cell2d *c;
+      face2d *f;
+      int j, l, q, faces = 0, cur_id;
+
+      for( j = first[p] ; j < first[p+1] ; j++ )
+      {
+         c = cells[ order[j] ];
+         for( l = 0 ; l < 3 ; l++ )
+         {
+            used.push_back( c->face[l].node->id );
+            f = c->face[l].adj;
+            if( f == 0 || part[ num - f->cell->id ] != p )
+               faces++;
+         }
+      }
+      sort( used.begin(), used.end() );
+      used.erase( unique( used.begin(), used.end() ), used.end() );
+
+      snprintf( name, sizeof( name ), "%s.%i.msh", prefix, p );
+      if( ( stream = fopen( name, "w" ) ) == 0 )
+      {
+         failed[p] = 1;
+         return;
+      }
+      fprintf( stream, "$NOD\n" );
+      fprintf( stream, "%i\n", (int) used.size() );
+      for( j = 0 ; j < (int) used.size() ; j++ )
+      {
+         node2d *nd = nodes[ used[j] ];
+         fprintf( stream, "%6i  % .12f  % .12f  % .1f\n", nd->id, nd->p.x, nd->p.y, 0.0 );
+      }
+      fprintf( stream, "$ENDNOD\n" );
+      fprintf( stream, "$ELM\n" );
+      fprintf( stream, "%i\n", first[p+1] - first[p] + faces );
+      for( j = first[p] ; j < first[p+1] ; j++ )
+      {
+         c = cells[ order[j] ];
+         fprintf( stream, "%6i  2  0  0  3  %6i  %6i  %6i\n", order[j],
+                  c->face[2].node->id, c->face[1].node->id, c->face[0].node->id );
+      }
+      cur_id = num;
+      for( j = first[p] ; j < first[p+1] ; j++ )
+      {
+         c = cells[ order[j] ];
+         for( l = 0 ; l < 3 ; l++ )
+         {
+            f = c->face[l].adj;
+            node2d *nd_1 = c->face[ FAC2D[l][0] ].node;
+            node2d *nd_0 = c->face[ FAC2D[l][1] ].node;
+            if( f == 0 )
+               fprintf( stream, "%6i  1  0  %i  2  %6i  %6i\n", cur_id++,
+                        nd_0->bc_type & nd_1->bc_type, nd_0->id, nd_1->id );
+            else if( ( q = part[ num - f->cell->id ] ) != p )
+               fprintf( stream, "%6i  1  %i  0  2  %6i  %6i\n", cur_id++, q + 1, nd_0->id, nd_1->id );
+         }
+      }
+      fprintf( stream, "$ENDELM\n\n" );
+      if( fclose( stream ) != 0 )
+         failed[p] = 1;
+   } );
+
+   for( k = 0 ; k < parts ; k++ )
+      if( failed[k] )
+      {
+         printf( "mesh2d::save_partitions: cannot write %s.%i.msh\n", prefix, k );
+         return false;
+      }
+   printf( "Partition files: %i parts written to %s.*.msh\n", parts, prefix );
+   return true;
+}
+
+//***EOF************************************************************************
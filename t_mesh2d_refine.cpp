@@ -0,0 +1,279 @@
+/***************************************************************************
+                            mesh generation code
+                            --------------------
+    uniform refinement of a generated mesh
+    copyright               : (C) 2001 by Joao Carlos de Campos Henriques
+    email                   : jcch@popsrv.ist.utl.pt
+ ***************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <map>
+
+#include "t_mesh2d.h"
+#include "t_mesh2d_thread.h"
+
+using namespace mesh_2d;
+
+static const int refine_block = 1024;    // cells split in a row by a worker
+
+//
+// the mid node of the edge ab inside the mesh: the spacing and the metric
+// are the means of the ends
+//
+static void
+inner_mid_node( node2d *a, node2d *b, node2d *n )
+{
+   n->p.x = 0.5 * ( a->p.x + b->p.x );
+   n->p.y = 0.5 * ( a->p.y + b->p.y );
+   n->param = 0.0;
+   n->bc_type = n->bc_index = n->bc_surface = 0;
+   n->h = 0.5 * ( a->h + b->h );
+   for( int i = 0 ; i < 3 ; i++ )
+      n->m[i] = 0.5 * ( a->m[i] + b->m[i] );
+}
+
+//
+// the mid node of the boundary edge ab, on the straight edge: the bc_type
+// is the one of the face, as export_arrays gives it
+//
+static void
+boundary_mid_node( node2d *a, node2d *b, node2d *n )
+{
+   inner_mid_node( a, b, n );
+   n->param = 0.5 * ( a->param + b->param );
+   n->bc_type = a->bc_type & b->bc_type;
+   n->bc_surface = ( a->bc_surface == b->bc_surface ? a->bc_surface : 0 );
+}
+
+//
+// One red refinement step. The cells and the nodes are numbered as
+// export_arrays does, the cell of index p is replaced by the four cells of
+// index 4p .. 4p+3: the corner cells 4p+i at its node i, in the place of
+// the parent, and the centre cell 4p+3 with the mid node of face k as its
+// node k. The edge of a face is owned by the cell with the larger id, or
+// by the only cell at the boundary; its mid node is the one left by
+// convert_to_tri6 if any. The new nodes follow the old ones in the order of
+// their owners, node_parent grows by the two ends of their edges. Only the
+// allocations and the interpolator run serially.
+//
+void
+mesh2d::refine_level( tri6_xda_interpolator *bi, vector<int> *node_parent, int threads )
+{
+   typedef pair<face2d*, node2d*> snap_item;
+
+   vector<cell2d*> cells, kids;
+   vector<int> owned;
+   vector<char> placed;
+   vector<snap_item> snaps;
+   node2d_list::iterator itn;
+   cell2d_set::iterator itc;
+   node2d *n;
+   face2d *f;
+   int num, num_nodes, num_mids, p, k;
+
+   num = mesh_cells.size();
+   cells.reserve( num );
+   for( itc = mesh_cells.begin(), k = num ; itc != mesh_cells.end() ; itc++ )
+   {
+      (*itc)->id = k--;
+      cells.push_back( *itc );
+   }
+   for( itn = mesh_nodes.begin(), k = 0 ; itn != mesh_nodes.end() ; itn++ )
+      (*itn)->id = k++;
+   num_nodes = k;
+   cur_node_id = num_nodes - 1;
+   //
+   // owned edges
+   //
+   owned.assign( num, 0 );
+   parallel_for( threads, num, refine_block, [&]( int q ) {
+      for( int j = 0 ; j < 3 ; j++ )
+      {
+         face2d *g = cells[q]->face + j;
+         if( g->adj == 0 || g->adj->cell->id < cells[q]->id )
+            owned[q]++;
+      }
+   } );
+   for( p = 0, num_mids = 0 ; p < num ; p++ )
+      num_mids += owned[p];
+   placed.assign( num_mids, 0 );
+
+   for( p = 0 ; p < num ; p++ )
+   {
+      for( k = 0 ; k < 3 ; k++ )
+      {
+         f = cells[p]->face + k;
+         if( f->adj != 0 && f->adj->cell->id > cells[p]->id )
+            continue;
+         n = f->mid_node;
+         if( n == 0 )
+         {
+            n = node_alloc( 0 );
+            f->mid_node = n;
+            if( f->adj == 0 )
+               snaps.push_back( snap_item( f, n ) );
+         }
+         else
+            placed[ cur_node_id + 1 - num_nodes ] = 1;
+         n->id = ++cur_node_id;
+         mesh_nodes.push_back( n );
+         if( f->adj != 0 )
+            f->adj->mid_node = n;
+      }
+   }
+   mid_nodes.clear();
+
+   if( node_parent )
+      node_parent->resize( 2 * ( num_nodes + num_mids ) );
+   parallel_for( threads, num, refine_block, [&]( int q ) {
+      for( int j = 0 ; j < 3 ; j++ )
+      {
+         face2d *g = cells[q]->face + j;
+         if( g->adj != 0 && g->adj->cell->id > cells[q]->id )
+            continue;
+         node2d *a = succ_node( g ), *b = pred_node( g ), *m = g->mid_node;
+         if( node_parent )
+         {
+            (*node_parent)[ 2*m->id+0 ] = a->id;
+            (*node_parent)[ 2*m->id+1 ] = b->id;
+         }
+         if( placed[ m->id - num_nodes ] )
+            continue;
+         if( g->adj != 0 )
+            inner_mid_node( a, b, m );
+         else
+            boundary_mid_node( a, b, m );
+      }
+   } );
+   //
+   // the mid nodes of two periodic edges, with the same bc_index pair at
+   // the ends, are periodic images too
+   //
+   map<pair<int,int>, int> periodic;
+   int max_index = 0;
+   for( itn = mesh_nodes.begin() ; itn != mesh_nodes.end() ; itn++ )
+      max_index = max( max_index, (*itn)->bc_index );
+   for( k = 0 ; k < (int) snaps.size() ; k++ )
+   {
+      node2d *a = succ_node( snaps[k].first ), *b = pred_node( snaps[k].first );
+      if( a->bc_index == 0 || b->bc_index == 0 )
+         continue;
+      pair<int,int> key( min( a->bc_index, b->bc_index ), max( a->bc_index, b->bc_index ) );
+      map<pair<int,int>, int>::iterator itp = periodic.find( key );
+      if( itp == periodic.end() )
+         itp = periodic.insert( make_pair( key, ++max_index ) ).first;
+      snaps[k].second->bc_index = itp->second;
+   }
+   //
+   // the interpolator snaps the boundary mid nodes to the curves
+   //
+   if( bi )
+      for( k = 0 ; k < (int) snaps.size() ; k++ )
+         bi->interpolate( succ_node( snaps[k].first ), pred_node( snaps[k].first ), snaps[k].second );
+
+   kids.resize( 4 * num );
+   for( k = 0 ; k < 4 * num ; k++ )
+      kids[k] = cell_alloc( 4 * num - k );
+
+   parallel_for( threads, num, refine_block, [&]( int q ) {
+      cell2d *c = cells[q], *a, *m = kids[ 4*q+3 ];
+      face2d *g;
+      int i, j, l, r;
+
+      for( i = 0 ; i < 3 ; i++ )
+      {
+         a = kids[ 4*q+i ];
+         for( j = 0 ; j < 3 ; j++ )
+            a->face[j].node = ( j == i ? c->face[i].node : c->face[ 3 - i - j ].mid_node );
+         m->face[i].node = c->face[i].mid_node;
+      }
+      for( i = 0 ; i < 3 ; i++ )
+      {
+         a = kids[ 4*q+i ];
+         a->face[i].adj = m->face + i;
+         m->face[i].adj = a->face + i;
+         for( j = 0 ; j < 3 ; j++ )
+         {
+            g = c->face[j].adj;
+            if( j == i || g == 0 )
+               continue;
+            l = num - g->cell->id;
+            r = node_index( g->cell, c->face[i].node );
+            a->face[j].adj = kids[ 4*l+r ]->face + g->id;
+         }
+      }
+      for( i = 0 ; i < 4 ; i++ )
+      {
+         a = kids[ 4*q+i ];
+         a->bad = false;
+         circun_circle( a );
+      }
+   } );
+
+   for( p = 0 ; p < num ; p++ )
+      delete cells[p];
+   mesh_cells.clear();
+   for( k = 0 ; k < 4 * num ; k++ )
+      mesh_cells.insert( mesh_cells.end(), kids[k] );
+   cur_cell_id = 4 * num;
+   //
+   // the spacing halves
+   //
+   for( itn = mesh_nodes.begin() ; itn != mesh_nodes.end() ; itn++ )
+   {
+      n = *itn;
+      n->h *= 0.5;
+      for( k = 0 ; k < 3 ; k++ )
+         n->m[k] *= 4.0;
+   }
+}
+
+bool
+mesh2d::refine_uniform( int levels, tri6_xda_interpolator *bi, vector<int> *node_parent, int threads )
+{
+   node2d_list::iterator itn;
+   cell2d_set::iterator itc;
+   int l, i, num_nodes;
+
+   if( spill_chunk > 0 )
+   {
+      printf( "mesh2d::refine_uniform: not available with the out of core storage.\n" );
+      return false;
+   }
+   if( !bad_cells.empty() || !fist_front.empty() )
+   {
+      printf( "mesh2d::refine_uniform: the mesh generation is not finished.\n" );
+      return false;
+   }
+
+   threads = worker_threads( threads );
+   num_nodes = mesh_nodes.size();
+   if( node_parent )
+   {
+      node_parent->resize( 2 * num_nodes );
+      for( i = 0 ; i < num_nodes ; i++ )
+         (*node_parent)[ 2*i+0 ] = (*node_parent)[ 2*i+1 ] = i;
+   }
+   for( l = 0 ; l < levels ; l++ )
+   {
+      refine_level( bi, node_parent, threads );
+   }
+
+   clear_locate_grid();
+   if( adjacent_linked )
+   {
+      for( itn = mesh_nodes.begin() ; itn != mesh_nodes.end() ; itn++ )
+         (*itn)->head = 0;
+      for( itc = mesh_cells.begin() ; itc != mesh_cells.end() ; itc++ )
+         add_cell_to_nodes( *itc );
+   }
+
+   printf( "Uniform refinement: %i levels, %i nodes, %i cells\n", levels,
+           (int) mesh_nodes.size(), (int) mesh_cells.size() );
+   return true;
+}
+
+//***EOF************************************************************************
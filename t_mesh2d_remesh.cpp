@@ -0,0 +1,519 @@
+/***************************************************************************
+                            mesh generation code
+                            --------------------
+    local remeshing of a generated mesh
+    copyright               : (C) 2001 by Joao Carlos de Campos Henriques
+    email                   : jcch@popsrv.ist.utl.pt
+ ***************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <map>
+
+#include "t_mesh2d.h"
+
+using namespace mesh_2d;
+
+//
+// even-odd rule
+//
+static bool
+inside_polygon( int n, const double *x, const double *y, double px, double py )
+{
+   bool in = false;
+   int i, j;
+
+   for( i = 0, j = n - 1 ; i < n ; j = i++ )
+      if( ( y[i] > py ) != ( y[j] > py ) &&
+          px < x[j] + ( x[i] - x[j] ) * ( py - y[j] ) / ( y[i] - y[j] ) )
+         in = !in;
+   return in;
+}
+
+//
+// the region boundary faces: without neighbour or with the neighbour outside
+//
+static inline bool
+is_region_face( face2d *f, unsigned stamp )
+{
+   return( f->adj == 0 || f->adj->cell->mark != stamp );
+}
+
+bool
+mesh2d::remesh_region( int n, const double *x, const double *y )
+{
+   cell2d_set::iterator itc;
+   vector<cell2d*> cells;
+   cell2d *c;
+
+   if( n < 3 )
+   {
+      printf( "mesh2d::remesh_region: the polygon needs at least three points.\n" );
+      return false;
+   }
+   for( itc = mesh_cells.begin() ; itc != mesh_cells.end() ; itc++ )
+   {
+      c = *itc;
+      if( inside_polygon( n, x, y,
+            ( c->face[0].node->p.x + c->face[1].node->p.x + c->face[2].node->p.x ) / 3.0,
+            ( c->face[0].node->p.y + c->face[1].node->p.y + c->face[2].node->p.y ) / 3.0 ) )
+         cells.push_back( c );
+   }
+   return remesh_region( cells );
+}
+
+bool
+mesh2d::remesh_region( const vector<cell2d*>& cells, double split )
+{
+   typedef map<pair<int,int>, face2d*> face_map;
+
+   vector<cell2d*> region;
+   vector<vector<face2d*> > loops;
+   map<int, face2d*> out;
+   map<int, face2d*>::iterator ito;
+   face_map interface;
+   face_map::iterator itf;
+   cell2d_set::iterator itc;
+   node2d_list::iterator itn;
+   cell2d *c, *a;
+   face2d *f;
+   node2d *v, *w, *u;
+   link2d *lk;
+   unsigned stamp, unset, gone, kept, dropped;
+   double hm, len, t;
+   int i, j, k, first_cell, first_node, size, pieces;
+   bool pinched, grown;
+
+   if( spill_chunk > 0 )
+   {
+      printf( "mesh2d::remesh_region: not available with the out of core storage.\n" );
+      return false;
+   }
+   if( !bad_cells.empty() )
+   {
+      printf( "mesh2d::remesh_region: the mesh generation is not finished.\n" );
+      return false;
+   }
+
+   stamp = next_epoch();
+   for( i = 0 ; i < (int) cells.size() ; i++ )
+      if( cells[i]->mark != stamp )
+      {
+         cells[i]->mark = stamp;
+         region.push_back( cells[i] );
+      }
+   if( region.empty() )
+   {
+      printf( "mesh2d::remesh_region: no cells in the region.\n" );
+      return false;
+   }
+   //
+   // a node where the region touches itself would be visited twice by the
+   // boundary loops: the cells around it join the region
+   //
+   do
+   {
+      out.clear();
+      pinched = false;
+      for( i = 0 ; i < (int) region.size() && !pinched ; i++ )
+         for( j = 0 ; j < 3 ; j++ )
+         {
+            f = region[i]->face + j;
+            if( !is_region_face( f, stamp ) )
+               continue;
+            v = succ_node( f );
+            if( out.insert( make_pair( v->id, f ) ).second )
+               continue;
+
+            pinched = true;
+            grown = false;
+            size = region.size();
+            for( k = 0 ; k < size ; k++ )
+            {
+               c = region[k];
+               if( c->face[0].node != v && c->face[1].node != v && c->face[2].node != v )
+                  continue;
+               for( int m = 0 ; m < 3 ; m++ )
+               {
+                  if( c->face[m].adj == 0 )
+                     continue;
+                  a = c->face[m].adj->cell;
+                  if( a->mark == stamp )
+                     continue;
+                  if( a->face[0].node != v && a->face[1].node != v && a->face[2].node != v )
+                     continue;
+                  a->mark = stamp;
+                  region.push_back( a );
+                  grown = true;
+               }
+            }
+            if( !grown )
+            {
+               printf( "mesh2d::remesh_region: the region boundary touches itself at node %i.\n", v->id );
+               return false;
+            }
+            break;
+         }
+   }
+   while( pinched );
+   //
+   // chain the faces into closed loops
+   //
+   while( !out.empty() )
+   {
+      vector<face2d*> loop;
+      int start = out.begin()->first;
+
+      ito = out.begin();
+      do
+      {
+         f = ito->second;
+         out.erase( ito );
+         loop.push_back( f );
+         v = pred_node( f );
+         ito = out.find( v->id );
+      }
+      while( v->id != start && ito != out.end() );
+
+      if( v->id != start )
+         THROW__X( "mesh2d::remesh_region: open region boundary.\n" );
+      loops.push_back( loop );
+   }
+   //
+   // Fronts added since the last generation are waiting in the fist front;
+   // they take the place of the boundary loops wholly inside the region.
+   // The nodes of the region are deleted but for the kept loops.
+   //
+   bool replace = !fist_front.empty();
+   int num_dropped = 0;
+   //
+   // the nodes keep the spacing they were generated with, the mean length
+   // of their edges is used if they have none, e.g. after load
+   //
+   unset = next_epoch();
+   for( i = 0 ; i < (int) region.size() ; i++ )
+      for( j = 0 ; j < 3 ; j++ )
+      {
+         v = region[i]->face[j].node;
+         if( v->h == 0.0 )
+         {
+            v->mark = unset;
+            v->degree = 0.0;
+         }
+      }
+   for( i = 0 ; i < (int) region.size() ; i++ )
+      for( j = 0 ; j < 3 ; j++ )
+      {
+         f = region[i]->face + j;
+         double l = norm( succ_node( f )->p.x - pred_node( f )->p.x,
+                          succ_node( f )->p.y - pred_node( f )->p.y );
+         if( succ_node( f )->mark == unset )
+         {
+            succ_node( f )->h += l;
+            succ_node( f )->degree += 1.0;
+         }
+         if( pred_node( f )->mark == unset )
+         {
+            pred_node( f )->h += l;
+            pred_node( f )->degree += 1.0;
+         }
+      }
+   for( i = 0 ; i < (int) region.size() ; i++ )
+      for( j = 0 ; j < 3 ; j++ )
+      {
+         v = region[i]->face[j].node;
+         if( v->mark == unset )
+         {
+            v->h /= v->degree;
+            v->mark = 0;
+         }
+      }
+
+   gone = next_epoch();
+   for( i = 0 ; i < (int) region.size() ; i++ )
+      for( j = 0 ; j < 3 ; j++ )
+         region[i]->face[j].node->mark = gone;
+
+   dropped = next_epoch();
+   kept = next_epoch();
+   for( i = 0 ; i < (int) loops.size() ; i++ )
+   {
+      vector<face2d*>& loop = loops[i];
+      bool inner = true;
+
+      for( j = 0 ; j < (int) loop.size() && inner ; j++ )
+         inner = ( loop[j]->adj == 0 );
+      if( replace && inner )
+      {
+         num_dropped++;
+         for( j = 0 ; j < (int) loop.size() ; j++ )
+            if( succ_node( loop[j] )->mark != kept )
+               succ_node( loop[j] )->mark = dropped;
+         continue;
+      }
+      //
+      // the region is meshed detached from the rest of the mesh
+      //
+      vector<link2d*> lks;
+      for( j = 0 ; j < (int) loop.size() ; j++ )
+      {
+         f = loop[j];
+         v = succ_node( f );
+         v->mark = kept;
+
+         lks.push_back( lk = link_alloc( ++cur_link_id ) );
+         lk->node = v;
+         lk->adj  = 0;
+         if( f->adj != 0 )
+         {
+            interface[ edge_key( v, pred_node( f ) ) ] = f->adj;
+            f->adj->adj = 0;
+            continue;
+         }
+         //
+         // a long boundary face is split on the straight face in pieces of
+         // about the spacing, the new nodes as refine makes them
+         //
+         w = pred_node( f );
+         hm = 0.5 * ( v->h + w->h );
+         len = norm( w->p.x - v->p.x, w->p.y - v->p.y );
+         if( split <= 0.0 || len <= split * hm )
+            continue;
+         for( k = 1, pieces = (int) ceil( len / hm ) ; k < pieces ; k++ )
+         {
+            t = (double) k / pieces;
+            u = node_alloc( ++cur_node_id );
+            u->p.x = v->p.x + t * ( w->p.x - v->p.x );
+            u->p.y = v->p.y + t * ( w->p.y - v->p.y );
+            u->param = v->param + t * ( w->param - v->param );
+            u->bc_type = v->bc_type & w->bc_type;
+            u->bc_surface = ( v->bc_surface == w->bc_surface ? v->bc_surface : 0 );
+            u->h = v->h + t * ( w->h - v->h );
+            for( int m = 0 ; m < 3 ; m++ )
+               u->m[m] = v->m[m] + t * ( w->m[m] - v->m[m] );
+            mesh_nodes.push_back( u );
+
+            lks.push_back( lk = link_alloc( ++cur_link_id ) );
+            lk->node = u;
+            lk->adj  = 0;
+         }
+      }
+      for( j = 0 ; j < (int) lks.size() ; j++ )
+      {
+         lks[j]->next = lks[ ( j + 1 ) % lks.size() ];
+         lks[j]->prev = lks[ ( j + lks.size() - 1 ) % lks.size() ];
+      }
+      for( j = 0 ; j < (int) lks.size() ; j++ )
+         fist_front.insert( lks[j] );
+   }
+
+   for( itc = back_mesh.begin() ; itc != back_mesh.end() ; itc++ )
+      delete *itc;
+   back_mesh.clear();
+   back_array.clear();
+   back_start = 0;
+   //
+   // The region cells are the background mesh when they cover the whole
+   // hole, the spacing of their nodes is kept inside. A replaced loop
+   // leaves a hole uncovered, the background mesh is then made from the
+   // fist cells.
+   //
+   if( num_dropped == 0 )
+   {
+      for( i = 0 ; i < (int) region.size() ; i++ )
+      {
+         c = region[i];
+         a = cell_alloc( ++cur_cell_id );
+         a->id = c->id;
+         for( j = 0 ; j < 3 ; j++ )
+            a->face[j].node = c->face[j].node;
+         back_mesh.insert( a );
+      }
+      for( i = 0 ; i < (int) region.size() ; i++ )
+      {
+         c = region[i];
+         a = *back_mesh.find( c );
+         for( j = 0 ; j < 3 ; j++ )
+         {
+            f = c->face + j;
+            if( f->adj != 0 && f->adj->cell->mark == stamp && a->face[j].adj == 0 )
+               attach_faces( a->face + j, (*back_mesh.find( f->adj->cell ))->face + f->adj->id );
+         }
+      }
+   }
+
+   for( i = 0 ; i < (int) region.size() ; i++ )
+   {
+      if( adjacent_linked )
+         remove_cell_from_nodes( region[i] );
+      mesh_cells.erase( region[i] );
+      delete region[i];
+   }
+   //
+   // The generated nodes inside are deleted after the generation, the
+   // background mesh may use them. The nodes of the replaced loops may
+   // belong to a front block and are only unlinked.
+   //
+   vector<node2d*> gone_nodes;
+   for( itn = mesh_nodes.begin() ; itn != mesh_nodes.end() ; )
+   {
+      v = *itn;
+      if( v->mark == gone )
+      {
+         itn = mesh_nodes.erase( itn );
+         gone_nodes.push_back( v );
+      }
+      else if( v->mark == dropped )
+         itn = mesh_nodes.erase( itn );
+      else
+         itn++;
+   }
+
+   first_cell = cur_cell_id;
+   first_node = cur_node_id;
+
+   printf( "Remeshing %i cells, %i boundary loops\n", (int) region.size(), (int) loops.size() );
+   fist_generation();
+   if( !back_mesh.empty() )
+      set_back_planes();
+   mesh_generation();
+
+   for( itc = back_mesh.begin() ; itc != back_mesh.end() ; itc++ )
+      delete *itc;
+   back_mesh.clear();
+   back_array.clear();
+   back_start = 0;
+   for( i = 0 ; i < (int) gone_nodes.size() ; i++ )
+      delete gone_nodes[i];
+   //
+   // the new cells have the largest ids and come first in the set
+   //
+   cell2d_set fresh;
+   for( itc = mesh_cells.begin() ; itc != mesh_cells.end() && (*itc)->id > first_cell ; itc++ )
+      fresh.insert( fresh.end(), *itc );
+
+   smooth_region( fresh, first_node );
+   //
+   // attach the region to the rest of the mesh
+   //
+   k = 0;
+   for( itc = fresh.begin() ; itc != fresh.end() ; itc++ )
+   {
+      c = *itc;
+      for( j = 0 ; j < 3 ; j++ )
+      {
+         f = c->face + j;
+         if( f->adj != 0 )
+            continue;
+         itf = interface.find( edge_key( succ_node( f ), pred_node( f ) ) );
+         if( itf == interface.end() )
+            continue;
+         attach_faces( f, itf->second );
+         k++;
+      }
+      if( adjacent_linked )
+         add_cell_to_nodes( c );
+   }
+   if( k != (int) interface.size() )
+      THROW__X( "mesh2d::remesh_region: region boundary faces not found.\n" );
+
+   printf( "Remeshed region: %i cells\n", (int) fresh.size() );
+   return true;
+}
+
+//
+// smooth() restricted to the cells s, moving only the nodes created after
+// first_node
+//
+void
+mesh2d::smooth_region( cell2d_set& s, int first_node )
+{
+   cell2d_set::iterator itc;
+   cell2d *c;
+   node2d *nn, *ns, *np;
+   int i, num = cur_node_id - first_node;
+
+   if( num <= 0 )
+      return;
+
+   make_delaunay( &s );
+   vector<double> nx( num, 0.0 ), ny( num, 0.0 ), sa( num, 0.0 );
+
+   for( itc = s.begin() ; itc != s.end() ; itc++ )
+      for( i = 0 ; i < 3 ; i++ )
+         (*itc)->face[i].node->degree = 0.0;
+   for( itc = s.begin() ; itc != s.end() ; itc++ )
+      for( i = 0 ; i < 3 ; i++ )
+         (*itc)->face[i].node->degree += 1.0;
+
+   for( itc = s.begin() ; itc != s.end() ; itc++ )
+   {
+      c = *itc;
+      for( i = 0 ; i < 3 ; i++ )
+      {
+         nn = c->face[i].node;
+         ns = succ_node( &c->face[i] );
+         np = pred_node( &c->face[i] );
+
+         if( nn->bc_type != 0 || nn->id <= first_node )
+            continue;
+
+         double as = max( 6.0, 1.0 + 3.0 * ( ns->degree - 6.0 ) );
+         double ap = max( 6.0, 1.0 + 3.0 * ( np->degree - 6.0 ) );
+         int k = nn->id - first_node - 1;
+
+         sa[k] += as + ap;
+         nx[k] += as * ns->p.x + ap * np->p.x;
+         ny[k] += as * ns->p.y + ap * np->p.y;
+      }
+   }
+   //
+   // the old position is kept in nx, ny; sa < 0 marks a moved node
+   //
+   for( itc = s.begin() ; itc != s.end() ; itc++ )
+      for( i = 0 ; i < 3 ; i++ )
+      {
+         nn = (*itc)->face[i].node;
+         int k = nn->id - first_node - 1;
+         if( nn->id <= first_node || sa[k] <= 0.0 )
+            continue;
+         p2d q = nn->p;
+         nn->p.x = nx[k] / sa[k];
+         nn->p.y = ny[k] / sa[k];
+         nx[k] = q.x;
+         ny[k] = q.y;
+         sa[k] = -1.0;
+      }
+   //
+   // a strongly graded region may fold over: the moves of the folded cells
+   // are taken back
+   //
+   bool changed = true;
+   while( changed )
+   {
+      changed = false;
+      for( itc = s.begin() ; itc != s.end() ; itc++ )
+      {
+         c = *itc;
+         if( cell_area( c ) > 0.0 )
+            continue;
+         for( i = 0 ; i < 3 ; i++ )
+         {
+            nn = c->face[i].node;
+            int k = nn->id - first_node - 1;
+            if( nn->id <= first_node || sa[k] >= 0.0 )
+               continue;
+            nn->p.x = nx[k];
+            nn->p.y = ny[k];
+            sa[k] = 0.0;
+            changed = true;
+         }
+      }
+   }
+
+   make_delaunay( &s );
+}
+
+//***EOF************************************************************************
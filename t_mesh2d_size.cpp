@@ -0,0 +1,494 @@
+/***************************************************************************
+                            mesh generation code
+                            --------------------
+    spacing function: background mesh and user spacing
+    copyright               : (C) 2001 by Joao Carlos de Campos Henriques
+    email                   : jcch@popsrv.ist.utl.pt
+ ***************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <queue>
+
+#include "t_mesh2d.h"
+
+using namespace mesh_2d;
+
+/***********************************************************************
+   background mesh
+ ***********************************************************************/
+
+//
+// Gradient and plane of the spacing on a background cell, from the h of
+// its nodes. The plane is evaluated by interpolate, one dot product.
+//
+void
+mesh2d::set_back_spacing( cell2d *cb )
+{
+   face2d *f;
+   node2d *nn, *np, *ns;
+   double nx, ny, meas;
+   int i;
+
+   cb->dh_dx = cb->dh_dy = 0.0;
+   for( i = 0 ; i < 3 ; i++ )
+   {
+      f = cb->face+i;
+
+      nn = f->node;
+      ns = succ_node( f );
+      np = pred_node( f );
+
+      nx = + np->p.y - ns->p.y;
+      ny = - np->p.x + ns->p.x;
+
+      cb->dh_dx += nn->h * nx;
+      cb->dh_dy += nn->h * ny;
+   }
+
+   meas = cell_area( cb );
+   cb->dh_dx /= meas;
+   cb->dh_dy /= meas;
+
+   double X1 = cb->face[0].node->p.x;
+   double Y1 = cb->face[0].node->p.y;
+   double h1 = cb->face[0].node->h;
+
+   double X2 = cb->face[2].node->p.x;
+   double Y2 = cb->face[2].node->p.y;
+   double h2 = cb->face[2].node->h;
+
+   double X3 = cb->face[1].node->p.x;
+   double Y3 = cb->face[1].node->p.y;
+   double h3 = cb->face[1].node->h;
+
+   double ar = ( X2*Y3 + X1*Y2 + X3*Y1 - Y1*X2 - Y2*X3 - Y3*X1 );
+   cb->hp[0] = ( h1*(X2*Y3-X3*Y2) + h2*(X3*Y1-X1*Y3) + h3*(X1*Y2-X2*Y1) ) / ar;
+   cb->hp[1] = ( h1*(Y2-Y3) + h2*(Y3-Y1) + h3*(Y1-Y2) ) / ar;
+   cb->hp[2] = ( h1*(X3-X2) + h2*(X1-X3) + h3*(X2-X1) ) / ar;
+}
+
+//
+// Dijkstra sweep from the smallest spacing: a node whose spacing is final
+// limits each neighbour to its own spacing plus gradation times the edge
+// length. O(N log N) in the background nodes.
+//
+void
+mesh2d::limit_gradation()
+{
+   typedef pair<double,int> hnode;
+
+   priority_queue<hnode, vector<hnode>, greater<hnode> > heap;
+   vector< vector<int> > nbr( cur_node_id + 1 );
+   vector<node2d*> nodes( cur_node_id + 1, (node2d*) 0 );
+   cell2d_set::iterator itb;
+   node2d *a, *b;
+   double h;
+   int i, j, id, changed = 0;
+
+   for( itb = back_mesh.begin() ; itb != back_mesh.end() ; itb++ )
+      for( i = 0 ; i < 3 ; i++ )
+      {
+         a = (*itb)->face[ succ[i] ].node;
+         b = (*itb)->face[ pred[i] ].node;
+         nodes[ a->id ] = a;
+         //
+         // an inner edge is seen from both cells, keep it once
+         //
+         if( (*itb)->face[i].adj == 0 || a->id < b->id )
+         {
+            nbr[ a->id ].push_back( b->id );
+            nbr[ b->id ].push_back( a->id );
+         }
+      }
+
+   for( id = 0 ; id <= cur_node_id ; id++ )
+      if( nodes[id] != 0 )
+         heap.push( hnode( nodes[id]->h, id ) );
+
+   while( !heap.empty() )
+   {
+      h  = heap.top().first;
+      id = heap.top().second;
+      heap.pop();
+
+      a = nodes[id];
+      if( h > a->h )                   // already lowered
+         continue;
+
+      for( j = 0 ; j < (int) nbr[id].size() ; j++ )
+      {
+         b = nodes[ nbr[id][j] ];
+         h = a->h + gradation * norm( b->p.x - a->p.x, b->p.y - a->p.y );
+         if( h < b->h )
+         {
+            b->h = h;
+            heap.push( hnode( h, b->id ) );
+            changed++;
+         }
+      }
+   }
+   printf( "Gradation %g lowered the spacing %i times\n\n", gradation, changed );
+}
+
+/***********************************************************************
+   user spacing
+ ***********************************************************************/
+
+void
+mesh2d::set_size_function( double (*f)( double x, double y, void *data ), void *data )
+{
+   size_func = f;
+   size_data = data;
+}
+
+void
+mesh2d::add_point_source( double x, double y, double h, double r, double growth )
+{
+   add_line_source( x, y, x, y, h, r, growth );
+}
+
+void
+mesh2d::add_line_source( double x0, double y0, double x1, double y1,
+                         double h, double r, double growth )
+{
+   size_source s;
+
+   if( h <= 0.0 || r < 0.0 || growth < 0.0 )
+   {
+      printf( "mesh2d::add_line_source: invalid source ignored\n" );
+      return;
+   }
+   s.x0 = x0;
+   s.y0 = y0;
+   s.x1 = x1;
+   s.y1 = y1;
+   s.h  = h;
+   s.r  = r;
+   s.growth = growth;
+   size_sources.push_back( s );
+}
+
+bool
+mesh2d::load_size_grid( const char *filename )
+{
+   size_grid g;
+   int i;
+
+   FILE *stream = fopen( filename, "r" );
+   if( stream == 0 )
+   {
+      fprintf( stderr, "%s: unable to open the size grid\n", filename );
+      return false;
+   }
+   if( fscanf( stream, "%i %i %lf %lf %lf %lf", &g.nx, &g.ny, &g.x0, &g.y0, &g.dx, &g.dy ) != 6 ||
+       g.nx < 2 || g.ny < 2 || g.dx <= 0.0 || g.dy <= 0.0 )
+   {
+      fprintf( stderr, "%s: invalid size grid header\n", filename );
+      fclose( stream );
+      return false;
+   }
+   g.h.resize( g.nx * g.ny );
+   for( i = 0 ; i < g.nx * g.ny ; i++ )
+      if( fscanf( stream, "%lf", &g.h[i] ) != 1 || g.h[i] <= 0.0 )
+      {
+         fprintf( stderr, "%s: invalid size grid value %i\n", filename, i );
+         fclose( stream );
+         return false;
+      }
+   fclose( stream );
+
+   back_grid = g;
+   return true;
+}
+
+//
+// smallest user spacing at (x,y), HUGE_VAL without one
+//
+double
+mesh2d::user_size( double x, double y )
+{
+   double h = HUGE_VAL, d, t, ex, ey, l2;
+   unsigned i;
+
+   if( size_func != 0 )
+      h = min( h, size_func( x, y, size_data ) );
+
+   for( i = 0 ; i < size_sources.size() ; i++ )
+   {
+      const size_source& s = size_sources[i];
+
+      ex = s.x1 - s.x0;
+      ey = s.y1 - s.y0;
+      l2 = ex * ex + ey * ey;
+      t  = ( l2 > 0.0 ? ( ( x - s.x0 ) * ex + ( y - s.y0 ) * ey ) / l2 : 0.0 );
+      t  = max( 0.0, min( t, 1.0 ) );
+      d  = norm( x - s.x0 - t * ex, y - s.y0 - t * ey );
+
+      h = min( h, d <= s.r ? s.h : s.h + s.growth * ( d - s.r ) );
+   }
+
+   if( back_grid.nx > 0 )
+   {
+      const size_grid& g = back_grid;
+      double u = ( x - g.x0 ) / g.dx;
+      double v = ( y - g.y0 ) / g.dy;
+
+      if( u >= 0.0 && v >= 0.0 && u <= g.nx - 1 && v <= g.ny - 1 )
+      {
+         int iu = min( (int) u, g.nx - 2 );
+         int iv = min( (int) v, g.ny - 2 );
+         const double *p = &g.h[ iv * g.nx + iu ];
+
+         u -= iu;
+         v -= iv;
+         h = min( h, ( 1.0 - v ) * ( ( 1.0 - u ) * p[0] + u * p[1] ) +
+                     v * ( ( 1.0 - u ) * p[g.nx] + u * p[g.nx+1] ) );
+      }
+   }
+   return h;
+}
+
+/***********************************************************************
+   metric spacing
+ ***********************************************************************/
+
+//
+// Intersection of the metrics a and b: in the basis where both are
+// diagonal, the larger of the two in each direction (the smaller size).
+//
+static void
+metric_intersect( const double a[3], const double b[3], double m[3] )
+{
+   double da = a[0] * a[2] - a[1] * a[1];
+   //
+   // n = a^-1 b, its eigenvectors diagonalize a and b
+   //
+   double n11 = ( a[2] * b[0] - a[1] * b[1] ) / da;
+   double n12 = ( a[2] * b[1] - a[1] * b[2] ) / da;
+   double n21 = ( a[0] * b[1] - a[1] * b[0] ) / da;
+   double n22 = ( a[0] * b[2] - a[1] * b[1] ) / da;
+
+   double ht = 0.5 * ( n11 + n22 );
+   double ds = ht * ht - ( n11 * n22 - n12 * n21 );
+
+   if( ds <= sqr( 1E-10 * ht ) )        // b = k a
+   {
+      const double *c = ( ht > 1.0 ? b : a );
+      m[0] = c[0];
+      m[1] = c[1];
+      m[2] = c[2];
+      return;
+   }
+
+   double v[2][2], s[2], q[2][2], l, dp;
+   int i;
+
+   for( i = 0 ; i < 2 ; i++ )
+   {
+      l = ht + ( i == 0 ? 1.0 : -1.0 ) * sqrt( ds );
+      if( norm( n12, l - n11 ) > norm( l - n22, n21 ) )
+      {
+         v[i][0] = n12;
+         v[i][1] = l - n11;
+      }
+      else
+      {
+         v[i][0] = l - n22;
+         v[i][1] = n21;
+      }
+      s[i] = max( a[0] * sqr( v[i][0] ) + 2.0 * a[1] * v[i][0] * v[i][1] + a[2] * sqr( v[i][1] ),
+                  b[0] * sqr( v[i][0] ) + 2.0 * b[1] * v[i][0] * v[i][1] + b[2] * sqr( v[i][1] ) );
+   }
+   //
+   // m = p^-T diag(s) p^-1, the columns of p are the eigenvectors
+   //
+   dp = v[0][0] * v[1][1] - v[1][0] * v[0][1];
+   q[0][0] =  v[1][1] / dp;
+   q[0][1] = -v[1][0] / dp;
+   q[1][0] = -v[0][1] / dp;
+   q[1][1] =  v[0][0] / dp;
+
+   m[0] = s[0] * q[0][0] * q[0][0] + s[1] * q[1][0] * q[1][0];
+   m[1] = s[0] * q[0][0] * q[0][1] + s[1] * q[1][0] * q[1][1];
+   m[2] = s[0] * q[0][1] * q[0][1] + s[1] * q[1][1] * q[1][1];
+}
+
+//
+// size tensor m^-1/2: linear in the spacing for an isotropic metric
+//
+static void
+metric_to_size( const double m[3], double s[3] )
+{
+   double dm = m[0] * m[2] - m[1] * m[1];
+   double i0 = m[2] / dm, i1 = -m[1] / dm, i2 = m[0] / dm;
+   double sd = sqrt( i0 * i2 - i1 * i1 );
+   double t  = sqrt( i0 + i2 + 2.0 * sd );
+
+   s[0] = ( i0 + sd ) / t;
+   s[1] = i1 / t;
+   s[2] = ( i2 + sd ) / t;
+}
+
+static void
+size_to_metric( const double s[3], double m[3] )
+{
+   double a = s[0] * s[0] + s[1] * s[1];
+   double b = s[1] * ( s[0] + s[2] );
+   double c = s[1] * s[1] + s[2] * s[2];
+   double d = a * c - b * b;
+
+   m[0] =  c / d;
+   m[1] = -b / d;
+   m[2] =  a / d;
+}
+
+//
+// mean spacing of a metric, the isotropic one of the same area
+//
+static double
+metric_size( const double m[3] )
+{
+   return pow( m[0] * m[2] - m[1] * m[1], -0.25 );
+}
+
+void
+mesh2d::set_metric_function( void (*f)( double x, double y, double m[3], void *data ), void *data )
+{
+   metric_func = f;
+   metric_data = data;
+}
+
+//
+// Metric of the background nodes from their spacing and the user metric.
+// h becomes the mean size of the metric. The circles of the boundary
+// triangulation are evaluated in the metric, it is not changed here: the
+// background mesh and parallel_generation use the same cells.
+//
+void
+mesh2d::set_back_metric()
+{
+   cell2d_set::iterator it;
+   unsigned stamp = next_epoch();
+   node2d *n;
+   double u[3];
+   int i;
+
+   for( it = back_mesh.begin() ; it != back_mesh.end() ; it++ )
+      for( i = 0 ; i < 3 ; i++ )
+      {
+         n = (*it)->face[i].node;
+         if( n->mark == stamp )
+            continue;
+         n->mark = stamp;
+
+         n->m[0] = n->m[2] = 1.0 / sqr( n->h );   // with the user spacing
+         n->m[1] = 0.0;
+
+         metric_func( n->p.x, n->p.y, u, metric_data );
+         metric_intersect( n->m, u, n->m );
+         n->h = metric_size( n->m );
+      }
+
+   for( it = bad_cells.begin() ; it != bad_cells.end() ; it++ )
+      circun_circle( *it );
+}
+
+//
+// Metric at (x,y): the size tensors of the nodes of the background cell cb
+// are interpolated, then intersected with the user spacing and metric.
+//
+void
+mesh2d::metric_at( cell2d *cb, double x, double y, double m[3] )
+{
+   node2d *n0 = cb->face[0].node;
+   node2d *n1 = cb->face[1].node;
+   node2d *n2 = cb->face[2].node;
+   double w[3], s[3], si[3], ws, u[3];
+   int i, j;
+
+   w[0] = ( n1->p.x - x ) * ( n2->p.y - y ) - ( n2->p.x - x ) * ( n1->p.y - y );
+   w[1] = ( n2->p.x - x ) * ( n0->p.y - y ) - ( n0->p.x - x ) * ( n2->p.y - y );
+   w[2] = ( n0->p.x - x ) * ( n1->p.y - y ) - ( n1->p.x - x ) * ( n0->p.y - y );
+   //
+   // the walk may stop on a cell near the point, stay in the convex hull
+   //
+   ws = 0.0;
+   for( i = 0 ; i < 3 ; i++ )
+   {
+      w[i] = max( 0.0, w[i] );
+      ws += w[i];
+   }
+
+   s[0] = s[1] = s[2] = 0.0;
+   for( i = 0 ; i < 3 ; i++ )
+   {
+      metric_to_size( cb->face[i].node->m, si );
+      for( j = 0 ; j < 3 ; j++ )
+         s[j] += ( ws > 0.0 ? w[i] / ws : 1.0 / 3.0 ) * si[j];
+   }
+   size_to_metric( s, m );
+
+   if( has_user_size() )
+   {
+      double h = user_size( x, y );
+      if( h < HUGE_VAL )
+      {
+         u[0] = u[2] = 1.0 / sqr( h );
+         u[1] = 0.0;
+         metric_intersect( m, u, m );
+      }
+   }
+   metric_func( x, y, u, metric_data );
+   metric_intersect( m, u, m );
+}
+
+//
+// new_point in the metric of the edge midpoint: the edge is mapped by the
+// Cholesky factor of the metric, where the ideal point makes an equilateral
+// cell of unit side.
+//
+void
+mesh2d::new_point_metric( edge2d *be, cell2d *cb )
+{
+   static const double sin60 = 0.5 * sqrt( 3.0 );
+
+   node2d *p0 = be->n0;
+   node2d *p1 = be->n1;
+   node2d *n2 = be->new_node;
+   double m[3];
+
+   metric_at( cb, n2->p.x, n2->p.y, m );
+
+   double f11 = sqrt( m[0] );
+   double f12 = m[1] / f11;
+   double f22 = sqrt( m[2] - f12 * f12 );
+
+   double ex = p1->p.x - p0->p.x;
+   double ey = p1->p.y - p0->p.y;
+   double mx = f11 * ex + f12 * ey;
+   double my = f22 * ey;
+   double nn = norm( mx, my );
+
+   double lmin = nn * sqrt( S2min_S2max - 0.25 );
+   double lmax = nn * sqrt( S2max_S2min - 0.25 );
+   double lm   = max( lmin, min( sin60, lmax ) );
+   //
+   // back to the physical space
+   //
+   double dy = lm * ( -mx / nn ) / f22;
+   double dx = ( lm * ( my / nn ) - f12 * dy ) / f11;
+
+   n2->p.x += dx;
+   n2->p.y += dy;
+   n2->m[0] = m[0];
+   n2->m[1] = m[1];
+   n2->m[2] = m[2];
+   n2->h = metric_size( m );
+
+   be->ins_cell = find_bad_cell( be->adj->cell, n2 );
+}
+
+//***EOF************************************************************************
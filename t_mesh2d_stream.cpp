@@ -11,6 +11,12 @@
 #include <config.h>
 #endif
 
+#include <vector>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
 #include "t_mesh2d.h"
 
 namespace mesh_2d
@@ -39,6 +45,7 @@ mesh2d_base::mesh2d_base( node2d* (*ndalloc)(int), cell2d* (*clalloc)(int) ,
    edge_alloc = ( edalloc ? edalloc : def_edge_alloc );
    cur_node_id = cur_cell_id = cur_link_id = 0;
    store_version = 0;
+   adjacent_linked = false;
 }
 
 mesh2d_base::~mesh2d_base() {}
@@ -362,6 +369,450 @@ mesh2d_base::save_gmsh( FILE *stream, void(*progress)(int) )
    fprintf( stream, "$ENDELM\n\n" );
 }
 
+/***********************************************************************
+   gmsh output of an out-of-core mesh
+ ***********************************************************************/
+
+template<class T>
+static size_t
+read_spill( vector<T>& buf, FILE *stream )
+{
+   buf.resize( buf.capacity() );
+   buf.resize( fread( &buf[0], sizeof(T), buf.size(), stream ) );
+   return buf.size();
+}
+
+void
+mesh2d::save_gmsh( FILE *stream, void(*progress)(int) )
+{
+   //
+   // Same layout as mesh2d_base::save_gmsh: the spilled records come first
+   // and are read back one chunk at a time. Faces pointing to spill_cell
+   // are inner faces. Only the node renumbering table, one int per node
+   // id, is held for the whole mesh.
+   //
+   node2d_list::iterator itn;
+   cell2d_set::iterator itc;
+   vector<int> new_id;
+   int num_nodes, num_cells, bc_faces = 0;
+   int cur_id, total_work, cur = 0;
+   size_t k;
+   int i;
+
+   node2d *nd;
+   cell2d *cl;
+   face2d *f;
+
+   if( spill_chunk == 0 )
+   {
+      mesh2d_base::save_gmsh( stream, progress );
+      return;
+   }
+   flush_spill();
+
+   for( itc = mesh_cells.begin() ; itc != mesh_cells.end() ; itc++ )
+      for( i = 0 ; i < 3 ; i++ )
+         if( (*itc)->face[i].adj == 0 )
+            bc_faces++;
+
+   num_nodes  = spill_num_nodes + mesh_nodes.size();
+   num_cells  = spill_num_cells + mesh_cells.size();
+   bc_faces  += spill_num_faces;
+   total_work = num_cells + bc_faces + num_nodes;
+
+   new_id.assign( cur_node_id + 1, -1 );
+
+   fprintf( stream, "$NOD\n" );
+   fprintf( stream, "%i\n", num_nodes );
+
+   cur_id = 0;
+   rewind( spill_nodes_file );
+   while( read_spill( spill_nodes_buf, spill_nodes_file ) )
+      for( k = 0 ; k < spill_nodes_buf.size() ; k++ )
+      {
+         spill_node2d& r = spill_nodes_buf[k];
+         new_id[ r.id ] = cur_id;
+         fprintf( stream, "%6i  % .12f  % .12f  % .1f\n", cur_id++, r.x, r.y, 0.0 );
+      }
+   for( itn = mesh_nodes.begin() ; itn != mesh_nodes.end() ; itn++ )
+   {
+      nd = *itn;
+      new_id[ nd->id ] = cur_id;
+      fprintf( stream, "%6i  % .12f  % .12f  % .1f\n", cur_id++, nd->p.x, nd->p.y, 0.0 );
+   }
+   cur = num_nodes;
+   if( progress )
+      progress( cur * 100 / total_work );
+
+   fprintf( stream, "$ENDNOD\n" );
+   fprintf( stream, "$ELM\n" );
+   fprintf( stream, "%i\n", num_cells + bc_faces );
+
+   cur_id = 0;
+   rewind( spill_cells_file );
+   while( read_spill( spill_cells_buf, spill_cells_file ) )
+      for( k = 0 ; k < spill_cells_buf.size() ; k++ )
+      {
+         spill_cell2d& r = spill_cells_buf[k];
+         fprintf( stream, "%6i  2  0  0  3  %6i  %6i  %6i\n", cur_id++,
+                  new_id[ r.node[0] ], new_id[ r.node[1] ], new_id[ r.node[2] ] );
+      }
+   for( itc = mesh_cells.begin() ; itc != mesh_cells.end() ; itc++ )
+   {
+      cl = *itc;
+      fprintf( stream, "%6i  2  0  0  3  %6i  %6i  %6i\n", cur_id++,
+               new_id[ cl->face[2].node->id ], new_id[ cl->face[1].node->id ],
+               new_id[ cl->face[0].node->id ] );
+   }
+   cur += num_cells;
+   if( progress )
+      progress( cur * 100 / total_work );
+
+   rewind( spill_faces_file );
+   while( read_spill( spill_faces_buf, spill_faces_file ) )
+      for( k = 0 ; k < spill_faces_buf.size() ; k++ )
+      {
+         spill_face2d& r = spill_faces_buf[k];
+         fprintf( stream, "%6i  1  0  %i  2  %6i  %6i\n", cur_id++, r.bc_type,
+                  new_id[ r.node[0] ], new_id[ r.node[1] ] );
+      }
+   for( itc = mesh_cells.begin() ; itc != mesh_cells.end() ; itc++ )
+   {
+      cl = *itc;
+      for( i = 0 ; i < 3 ; i++ )
+      {
+         f = cl->face+i;
+         if( f->adj != 0 )
+            continue;
+         node2d* nd_adj_1 = cl->face[ FAC2D[i][0] ].node;
+         node2d* nd_adj_0 = cl->face[ FAC2D[i][1] ].node;
+         fprintf( stream, "%6i  1  0  %i  2  %6i  %6i\n", cur_id++,
+                  nd_adj_0->bc_type & nd_adj_1->bc_type,
+                  new_id[ nd_adj_0->id ], new_id[ nd_adj_1->id ] );
+      }
+   }
+   if( progress )
+      progress( 100 );
+   fprintf( stream, "$ENDELM\n\n" );
+   fseek( spill_nodes_file, 0, SEEK_END );
+   fseek( spill_cells_file, 0, SEEK_END );
+   fseek( spill_faces_file, 0, SEEK_END );
+}
+
+/***********************************************************************
+   VTK XML unstructured grid (.vtu) with appended binary data
+ ***********************************************************************/
+
+typedef unsigned long long vtu_uint64;
+
+//
+// Streams one appended data array at a time. The values are copied into a
+// fixed size block and flushed (optionally zlib compressed) as soon as the
+// block is full, so no array is ever held in memory as a whole.
+//
+class vtu_appended_writer
+{
+   enum { BLOCK_SIZE = 32768 };   // multiple of every value size written
+
+   FILE           *stream;
+   bool            compress;
+   unsigned char  *block;
+   unsigned char  *zblock;
+   unsigned long   zblock_size;
+   size_t          fill;
+   size_t          nbytes;        // uncompressed size of the current array
+   long            header_pos;
+   vector<vtu_uint64> zsizes;
+
+   void flush_block();
+
+public:
+   vtu_uint64      offset;        // bytes written to the appended section
+
+   void begin( size_t bytes );
+   void end();
+
+   template<class T>
+   void put( const T &a )
+   {
+      if( fill + sizeof(T) > BLOCK_SIZE )
+         flush_block();
+      memcpy( block + fill, &a, sizeof(T) );
+      fill += sizeof(T);
+   }
+
+   vtu_appended_writer( FILE *s, bool z );
+   ~vtu_appended_writer();
+};
+
+vtu_appended_writer::vtu_appended_writer( FILE *s, bool z )
+{
+   stream = s;
+   compress = z;
+   block = new unsigned char[BLOCK_SIZE];
+   zblock = 0;
+   zblock_size = 0;
+#ifdef HAVE_ZLIB
+   if( compress )
+   {
+      zblock_size = compressBound( BLOCK_SIZE );
+      zblock = new unsigned char[zblock_size];
+   }
+#endif
+   fill = nbytes = 0;
+   header_pos = 0;
+   offset = 0;
+}
+
+vtu_appended_writer::~vtu_appended_writer()
+{
+   delete[] block;
+   delete[] zblock;
+}
+
+void
+vtu_appended_writer::begin( size_t bytes )
+{
+   vtu_uint64 zero = 0, size = bytes;
+   size_t i, nblocks;
+
+   nbytes = bytes;
+   fill = 0;
+
+   if( !compress )
+   {
+      fwrite( &size, sizeof(size), 1, stream );
+      offset += sizeof(size) + nbytes;
+      return;
+   }
+   //
+   // compressed header: [#blocks][block size][last block size][sizes...]
+   // is only known after compression, reserve its room and patch it later
+   //
+   nblocks = ( nbytes + BLOCK_SIZE - 1 ) / BLOCK_SIZE;
+   zsizes.clear();
+   header_pos = ftell( stream );
+   for( i = 0 ; i < 3 + nblocks ; i++ )
+      fwrite( &zero, sizeof(zero), 1, stream );
+}
+
+void
+vtu_appended_writer::flush_block()
+{
+   if( fill == 0 )
+      return;
+
+   if( !compress )
+      fwrite( block, 1, fill, stream );
+#ifdef HAVE_ZLIB
+   else
+   {
+      uLongf zsize = zblock_size;
+      if( compress2( zblock, &zsize, block, fill, Z_DEFAULT_COMPRESSION ) != Z_OK )
+         THROW__X( "vtu_appended_writer::flush_block: zlib compression failed." );
+      fwrite( zblock, 1, zsize, stream );
+      zsizes.push_back( zsize );
+   }
+#endif
+   fill = 0;
+}
+
+void
+vtu_appended_writer::end()
+{
+   vtu_uint64 head[3];
+   size_t i, last;
+   long end_pos;
+
+   last = nbytes % BLOCK_SIZE;
+   flush_block();
+
+   if( !compress )
+      return;
+
+   head[0] = zsizes.size();
+   head[1] = BLOCK_SIZE;
+   head[2] = ( last == 0 && nbytes != 0 ? (size_t) BLOCK_SIZE : last );
+
+   end_pos = ftell( stream );
+   fseek( stream, header_pos, SEEK_SET );
+   fwrite( head, sizeof(vtu_uint64), 3, stream );
+   for( i = 0 ; i < zsizes.size() ; i++ )
+      fwrite( &zsizes[i], sizeof(vtu_uint64), 1, stream );
+   fseek( stream, end_pos, SEEK_SET );
+
+   offset += end_pos - header_pos;
+}
+
+enum { VTU_H, VTU_BC_TYPE, VTU_QUALITY, VTU_PARTITION,
+       VTU_POINTS, VTU_CONNECTIVITY, VTU_OFFSETS, VTU_TYPES, VTU_ARRAYS };
+
+static void
+vtu_data_array( FILE *stream, const char *type, const char *name, int ncomp,
+                bool compress, vtu_uint64 offset, long *offset_pos )
+{
+   fprintf( stream, "        <DataArray type=\"%s\" Name=\"%s\"", type, name );
+   if( ncomp > 1 )
+      fprintf( stream, " NumberOfComponents=\"%i\"", ncomp );
+   fprintf( stream, " format=\"appended\" offset=\"" );
+   //
+   // compressed sizes are not known yet: zero padded placeholder patched at the end
+   //
+   *offset_pos = ftell( stream );
+   if( compress )
+      fprintf( stream, "%020llu", 0ULL );
+   else
+      fprintf( stream, "%llu", offset );
+   fprintf( stream, "\"/>\n" );
+}
+
+//
+// The partition array (one id per cell, in get_first_cell order) is optional.
+// With compression the stream must be seekable, the headers are patched.
+//
+void
+mesh2d_base::save_vtu( FILE *stream, const int *partition, bool compress, void(*progress)(int) )
+{
+   const int one = 1;
+   const bool little_endian = ( *(const char*) &one == 1 );
+   const int num_arrays = ( partition ? VTU_ARRAYS : VTU_ARRAYS - 1 );
+
+   vtu_uint64 sizes[VTU_ARRAYS], offsets[VTU_ARRAYS];
+   long offset_pos[VTU_ARRAYS];
+   int num_cells, num_nodes, cur_id, i, a, cur = 0;
+   unsigned char cell_type = 5;   // VTK_TRIANGLE
+
+   node2d* nd;
+   cell2d* cl;
+
+#ifndef HAVE_ZLIB
+   if( compress )
+   {
+      printf( "mesh2d_base::save_vtu: built without zlib, writing raw data.\n" );
+      compress = false;
+   }
+#endif
+
+   get_mesh_properties( &num_nodes, &num_cells );
+
+   sizes[VTU_H]            = num_nodes * sizeof(double);
+   sizes[VTU_BC_TYPE]      = num_nodes * sizeof(int);
+   sizes[VTU_QUALITY]      = num_cells * sizeof(double);
+   sizes[VTU_PARTITION]    = ( partition ? num_cells * sizeof(int) : 0 );
+   sizes[VTU_POINTS]       = num_nodes * 3 * sizeof(double);
+   sizes[VTU_CONNECTIVITY] = num_cells * 3 * sizeof(int);
+   sizes[VTU_OFFSETS]      = num_cells * sizeof(int);
+   sizes[VTU_TYPES]        = num_cells * sizeof(unsigned char);
+
+   for( a = 0, offsets[0] = 0 ; a < VTU_ARRAYS - 1 ; a++ )
+      offsets[a+1] = offsets[a] + ( a == VTU_PARTITION && !partition ? 0 : sizeof(vtu_uint64) + sizes[a] );
+
+   fprintf( stream, "<?xml version=\"1.0\"?>\n" );
+   fprintf( stream, "<VTKFile type=\"UnstructuredGrid\" version=\"1.0\" byte_order=\"%s\""
+                    " header_type=\"UInt64\"%s>\n", little_endian ? "LittleEndian" : "BigEndian",
+                    compress ? " compressor=\"vtkZLibDataCompressor\"" : "" );
+   fprintf( stream, "  <UnstructuredGrid>\n" );
+   fprintf( stream, "    <Piece NumberOfPoints=\"%i\" NumberOfCells=\"%i\">\n", num_nodes, num_cells );
+   fprintf( stream, "      <PointData Scalars=\"h\">\n" );
+   vtu_data_array( stream, "Float64", "h", 1, compress, offsets[VTU_H], offset_pos+VTU_H );
+   vtu_data_array( stream, "Int32", "bc_type", 1, compress, offsets[VTU_BC_TYPE], offset_pos+VTU_BC_TYPE );
+   fprintf( stream, "      </PointData>\n" );
+   fprintf( stream, "      <CellData Scalars=\"quality\">\n" );
+   vtu_data_array( stream, "Float64", "quality", 1, compress, offsets[VTU_QUALITY], offset_pos+VTU_QUALITY );
+   if( partition )
+      vtu_data_array( stream, "Int32", "partition", 1, compress, offsets[VTU_PARTITION], offset_pos+VTU_PARTITION );
+   fprintf( stream, "      </CellData>\n" );
+   fprintf( stream, "      <Points>\n" );
+   vtu_data_array( stream, "Float64", "points", 3, compress, offsets[VTU_POINTS], offset_pos+VTU_POINTS );
+   fprintf( stream, "      </Points>\n" );
+   fprintf( stream, "      <Cells>\n" );
+   vtu_data_array( stream, "Int32", "connectivity", 1, compress, offsets[VTU_CONNECTIVITY], offset_pos+VTU_CONNECTIVITY );
+   vtu_data_array( stream, "Int32", "offsets", 1, compress, offsets[VTU_OFFSETS], offset_pos+VTU_OFFSETS );
+   vtu_data_array( stream, "UInt8", "types", 1, compress, offsets[VTU_TYPES], offset_pos+VTU_TYPES );
+   fprintf( stream, "      </Cells>\n" );
+   fprintf( stream, "    </Piece>\n" );
+   fprintf( stream, "  </UnstructuredGrid>\n" );
+   fprintf( stream, "  <AppendedData encoding=\"raw\">\n   _" );
+
+   vtu_appended_writer vw( stream, compress );
+
+   for( a = 0 ; a < VTU_ARRAYS ; a++ )
+   {
+      if( a == VTU_PARTITION && !partition )
+         continue;
+
+      offsets[a] = vw.offset;
+      vw.begin( sizes[a] );
+
+      switch( a )
+      {
+      case VTU_H:
+         for( nd = get_first_node(), cur_id = 0 ; nd ; nd = get_next_node() )
+         {
+            nd->id = cur_id++; // renumbering for the connectivity
+            vw.put( nd->h );
+         }
+         break;
+      case VTU_BC_TYPE:
+         for( nd = get_first_node() ; nd ; nd = get_next_node() )
+            vw.put( nd->bc_type );
+         break;
+      case VTU_QUALITY:
+         for( cl = get_first_cell() ; cl ; cl = get_next_cell() )
+            vw.put( cell_quality( cl ) );
+         break;
+      case VTU_PARTITION:
+         for( i = 0 ; i < num_cells ; i++ )
+            vw.put( partition[i] );
+         break;
+      case VTU_POINTS:
+         for( nd = get_first_node() ; nd ; nd = get_next_node() )
+         {
+            vw.put( nd->p.x );
+            vw.put( nd->p.y );
+            vw.put( 0.0 );
+         }
+         break;
+      case VTU_CONNECTIVITY:
+         for( cl = get_first_cell() ; cl ; cl = get_next_cell() )
+         {
+            vw.put( cl->face[2].node->id );   // counter-clockwise
+            vw.put( cl->face[1].node->id );
+            vw.put( cl->face[0].node->id );
+         }
+         break;
+      case VTU_OFFSETS:
+         for( i = 1 ; i <= num_cells ; i++ )
+            vw.put( 3 * i );
+         break;
+      case VTU_TYPES:
+         for( i = 0 ; i < num_cells ; i++ )
+            vw.put( cell_type );
+         break;
+      }
+      vw.end();
+
+      if( progress )
+         progress( (++cur) * 100 / num_arrays );
+   }
+
+   fprintf( stream, "\n  </AppendedData>\n" );
+   fprintf( stream, "</VTKFile>\n" );
+
+   if( compress )
+   {
+      long end_pos = ftell( stream );
+      for( a = 0 ; a < VTU_ARRAYS ; a++ )
+      {
+         if( a == VTU_PARTITION && !partition )
+            continue;
+         fseek( stream, offset_pos[a], SEEK_SET );
+         fprintf( stream, "%020llu", offsets[a] );
+      }
+      fseek( stream, end_pos, SEEK_SET );
+   }
+}
+
 void
 mesh2d_base::recover_adjacent_links()
 {
@@ -0,0 +1,57 @@
+/***************************************************************************
+                            mesh generation code
+                            --------------------
+    worker threads shared by the parallel passes
+    copyright               : (C) 2001 by Joao Carlos de Campos Henriques
+    email                   : jcch@popsrv.ist.utl.pt
+ ***************************************************************************/
+
+#ifndef T_MESH2D_THREAD_H
+#define T_MESH2D_THREAD_H
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace mesh_2d {
+
+//
+// calls f(i) for i in [0,num) on `threads` threads, the indices are handed
+// out in blocks of `chunk`
+//
+template<class F>
+inline void
+parallel_for( int threads, int num, int chunk, F f )
+{
+   std::atomic<int> next( 0 );
+   std::vector<std::thread> pool;
+   int t;
+
+   threads = std::max( 1, std::min( threads, ( num + chunk - 1 ) / chunk ) );
+   auto work = [&]() {
+      int i, first;
+      while( ( first = next.fetch_add( chunk ) ) < num )
+         for( i = first ; i < num && i < first + chunk ; i++ )
+            f( i );
+   };
+   for( t = 1 ; t < threads ; t++ )
+      pool.push_back( std::thread( work ) );
+   work();
+   for( t = 0 ; t < (int) pool.size() ; t++ )
+      pool[t].join();
+}
+
+//
+// number of workers, one per core when threads is 0
+//
+inline int
+worker_threads( int threads )
+{
+   return( threads > 0 ? threads : std::max( 1, (int) std::thread::hardware_concurrency() ) );
+}
+
+}; // namespace mesh_2d
+#endif
+
+//***EOF************************************************************************
@@ -0,0 +1,392 @@
+/***************************************************************************
+                            mesh generation code
+                            --------------------
+    point location and solution transfer between meshes
+    copyright               : (C) 2001 by Joao Carlos de Campos Henriques
+    email                   : jcch@popsrv.ist.utl.pt
+ ***************************************************************************/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+
+#include "t_mesh2d.h"
+#include "t_mesh2d_thread.h"
+
+using namespace mesh_2d;
+
+static const int grid_cells     = 2;       // cells per bucket of the location grid
+static const int locate_block   = 4096;    // points located in a row by a worker
+
+/***********************************************************************
+   location grid
+ ***********************************************************************/
+
+static inline void
+cell_box( cell2d *c, double& x0, double& y0, double& x1, double& y1 )
+{
+   x0 = x1 = c->face[0].node->p.x;
+   y0 = y1 = c->face[0].node->p.y;
+   for( int i = 1 ; i < 3 ; i++ )
+   {
+      x0 = min( x0, c->face[i].node->p.x );
+      x1 = max( x1, c->face[i].node->p.x );
+      y0 = min( y0, c->face[i].node->p.y );
+      y1 = max( y1, c->face[i].node->p.y );
+   }
+}
+
+static inline int
+bucket( double x, double x0, double dx, int n )
+{
+   int i = (int) floor( ( x - x0 ) / dx );
+   return( max( 0, min( n - 1, i ) ) );
+}
+
+void
+mesh2d::build_cell_grid( cell_grid& g, int threads )
+{
+   node2d_list::iterator itn;
+   double xmin, ymin, xmax, ymax, w, h;
+   int num, i, j, k, b;
+
+   num = mesh_cells.size();
+   g.nx = g.ny = 0;
+   g.start.clear();
+   g.cells.clear();
+   if( num == 0 )
+      return;
+
+   xmin = ymin = HUGE_VAL;
+   xmax = ymax = -HUGE_VAL;
+   for( itn = mesh_nodes.begin() ; itn != mesh_nodes.end() ; itn++ )
+   {
+      xmin = min( xmin, (*itn)->p.x );
+      xmax = max( xmax, (*itn)->p.x );
+      ymin = min( ymin, (*itn)->p.y );
+      ymax = max( ymax, (*itn)->p.y );
+   }
+   w = xmax - xmin;
+   h = ymax - ymin;
+   //
+   // square buckets, about grid_cells cells each
+   //
+   double d = sqrt( w * h * grid_cells / num );
+   g.nx = max( 1, min( num, (int) ceil( w / d ) ) );
+   g.ny = max( 1, min( num, (int) ceil( h / d ) ) );
+   g.x0 = xmin;
+   g.y0 = ymin;
+   g.dx = max( w / g.nx, mesh_eps );
+   g.dy = max( h / g.ny, mesh_eps );
+   //
+   // the bucket ranges of the cells, then count and fill
+   //
+   vector<cell2d*> cells( mesh_cells.begin(), mesh_cells.end() );
+   vector<int> box( 4 * num );
+
+   parallel_for( worker_threads( threads ), num, 4096, [&]( int m ) {
+      double x0, y0, x1, y1;
+      cell_box( cells[m], x0, y0, x1, y1 );
+      box[ 4*m+0 ] = bucket( x0, g.x0, g.dx, g.nx );
+      box[ 4*m+1 ] = bucket( x1, g.x0, g.dx, g.nx );
+      box[ 4*m+2 ] = bucket( y0, g.y0, g.dy, g.ny );
+      box[ 4*m+3 ] = bucket( y1, g.y0, g.dy, g.ny );
+   } );
+
+   g.start.assign( g.nx * g.ny + 1, 0 );
+   for( k = 0 ; k < num ; k++ )
+      for( j = box[4*k+2] ; j <= box[4*k+3] ; j++ )
+         for( i = box[4*k+0] ; i <= box[4*k+1] ; i++ )
+            g.start[ j * g.nx + i + 1 ]++;
+   for( b = 0 ; b < g.nx * g.ny ; b++ )
+      g.start[b+1] += g.start[b];
+
+   vector<int> fill( g.start.begin(), g.start.end() - 1 );
+   g.cells.resize( g.start.back() );
+   for( k = 0 ; k < num ; k++ )
+      for( j = box[4*k+2] ; j <= box[4*k+3] ; j++ )
+         for( i = box[4*k+0] ; i <= box[4*k+1] ; i++ )
+            g.cells[ fill[ j * g.nx + i ]++ ] = cells[k];
+}
+
+//
+// Barycentric weights of the point of c closest to (x,y), returns the
+// squared distance to it, 0 inside.
+//
+static double
+closest_weights( cell2d *c, double x, double y, double w[3] )
+{
+   node2d *a, *b;
+   double ex, ey, t, d, best;
+   int i;
+
+   p2d *p0 = &c->face[0].node->p, *p1 = &c->face[1].node->p, *p2 = &c->face[2].node->p;
+   double area = ( p1->x - p0->x ) * ( p2->y - p0->y ) - ( p2->x - p0->x ) * ( p1->y - p0->y );
+
+   w[0] = ( ( p1->x - x ) * ( p2->y - y ) - ( p2->x - x ) * ( p1->y - y ) ) / area;
+   w[1] = ( ( p2->x - x ) * ( p0->y - y ) - ( p0->x - x ) * ( p2->y - y ) ) / area;
+   w[2] = 1.0 - w[0] - w[1];
+   if( w[0] >= 0.0 && w[1] >= 0.0 && w[2] >= 0.0 )
+      return 0.0;
+   //
+   // outside: the closest point is on the face opposite to a negative weight
+   //
+   best = HUGE_VAL;
+   double wb[3];
+   for( i = 0 ; i < 3 ; i++ )
+   {
+      a  = succ_node( c->face+i );
+      b  = pred_node( c->face+i );
+      ex = b->p.x - a->p.x;
+      ey = b->p.y - a->p.y;
+      t  = ( ( x - a->p.x ) * ex + ( y - a->p.y ) * ey ) / norm_sqr( ex, ey );
+      t  = max( 0.0, min( 1.0, t ) );
+      d  = norm_sqr( a->p.x + t * ex - x, a->p.y + t * ey - y );
+      if( d < best )
+      {
+         best = d;
+         wb[i] = 0.0;
+         wb[ succ[i] ] = 1.0 - t;
+         wb[ pred[i] ] = t;
+      }
+   }
+   w[0] = wb[0];
+   w[1] = wb[1];
+   w[2] = wb[2];
+   return best;
+}
+
+//
+// The cell holding n, or if n is outside the mesh the nearest cell, found
+// on the rings of buckets around the one of n.
+//
+cell2d*
+mesh2d::grid_cell( const cell_grid& g, node2d *n, bool& inside )
+{
+   cell2d *c, *best = 0;
+   double w[3], d, dmin = HUGE_VAL;
+   int i, j, k, r, bi, bj, b;
+
+   bi = bucket( n->p.x, g.x0, g.dx, g.nx );
+   bj = bucket( n->p.y, g.y0, g.dy, g.ny );
+
+   b = bj * g.nx + bi;
+   for( k = g.start[b] ; k < g.start[b+1] ; k++ )
+   {
+      c = g.cells[k];
+      if( det( c->face[1].node, c->face[2].node, n ) <= 0 &&
+          det( c->face[2].node, c->face[0].node, n ) <= 0 &&
+          det( c->face[0].node, c->face[1].node, n ) <= 0 )
+      {
+         inside = true;
+         return c;
+      }
+   }
+   inside = false;
+   //
+   // the buckets of ring r + 1 are at least r buckets away
+   //
+   for( r = 0 ; r < max( g.nx, g.ny ) ; r++ )
+   {
+      for( j = bj - r ; j <= bj + r ; j++ )
+      {
+         if( j < 0 || j >= g.ny )
+            continue;
+         for( i = bi - r ; i <= bi + r ; i += ( j == bj - r || j == bj + r || r == 0 ? 1 : 2 * r ) )
+         {
+            if( i < 0 || i >= g.nx )
+               continue;
+            b = j * g.nx + i;
+            for( k = g.start[b] ; k < g.start[b+1] ; k++ )
+            {
+               c = g.cells[k];
+               d = closest_weights( c, n->p.x, n->p.y, w );
+               if( d < dmin || ( d == dmin && c->id > best->id ) )
+               {
+                  dmin = d;
+                  best = c;
+               }
+            }
+         }
+      }
+      if( best != 0 && dmin <= sqr( r * min( g.dx, g.dy ) ) )
+         break;
+   }
+   return best;
+}
+
+/***********************************************************************
+   point location
+ ***********************************************************************/
+
+void
+mesh2d::clear_locate_grid()
+{
+   cell_grid g;
+   swap( locate_grid, g );
+}
+
+int
+mesh2d::locate( int n, const double *x, const double *y, cell2d **cell, double *weight,
+                bool nearest, int threads )
+{
+   int num_blocks, i;
+
+   if( is_out_of_core() )
+   {
+      printf( "mesh2d::locate: not with the out-of-core store.\n" );
+      return -1;
+   }
+   if( mesh_cells.empty() )
+   {
+      printf( "mesh2d::locate: the mesh has no cells.\n" );
+      return -1;
+   }
+   if( n <= 0 )
+      return 0;
+   //
+   // the grid of the present mesh, built once by the first caller
+   //
+   {
+      std::lock_guard<std::mutex> lock( locate_mutex );
+      if( locate_grid.nx == 0 || locate_cells != (int) mesh_cells.size() ||
+          locate_cell_id != cur_cell_id || locate_node_id != cur_node_id )
+      {
+         build_cell_grid( locate_grid, threads );
+         locate_cells   = mesh_cells.size();
+         locate_cell_id = cur_cell_id;
+         locate_node_id = cur_node_id;
+      }
+   }
+   const cell_grid& g = locate_grid;
+   //
+   // Hilbert order over the grid box, consecutive points are close
+   //
+   vector<pair<unsigned,int> > order( n );
+   double sx = 65535.0 / ( g.nx * g.dx ), sy = 65535.0 / ( g.ny * g.dy );
+   for( i = 0 ; i < n ; i++ )
+   {
+      double hx = max( 0.0, min( 65535.0, ( x[i] - g.x0 ) * sx ) );
+      double hy = max( 0.0, min( 65535.0, ( y[i] - g.y0 ) * sy ) );
+      order[i] = make_pair( hilbert_key( (unsigned) hx, (unsigned) hy ), i );
+   }
+   sort( order.begin(), order.end() );
+   //
+   // each block walks from its previous hit when the next point is in a
+   // neighbouring bucket, and asks the grid otherwise
+   //
+   std::atomic<int> outside( 0 );
+   num_blocks = ( n + locate_block - 1 ) / locate_block;
+
+   parallel_for( worker_threads( threads ), num_blocks, 1, [&]( int blk ) {
+      cell2d *c, *prv = 0;
+      node2d q;
+      unsigned seed = blk + 1;
+      double w[3];
+      bool inside;
+      int j, k, m, bi, bj, pi = -2, pj = -2, out = 0;
+
+      for( m = blk * locate_block ; m < n && m < ( blk + 1 ) * locate_block ; m++ )
+      {
+         j = order[m].second;
+         q.p.x = x[j];
+         q.p.y = y[j];
+         bi = bucket( q.p.x, g.x0, g.dx, g.nx );
+         bj = bucket( q.p.y, g.y0, g.dy, g.ny );
+
+         c = 0;
+         inside = true;
+         if( prv != 0 && abs( bi - pi ) <= 1 && abs( bj - pj ) <= 1 )
+            c = walk_cell( prv, &q, seed );
+         if( c == 0 )
+            c = grid_cell( g, &q, inside );
+         if( !inside )
+            out++;
+
+         if( inside || nearest )
+         {
+            closest_weights( c, q.p.x, q.p.y, w );
+            prv = c;
+            pi = bi;
+            pj = bj;
+         }
+         else
+         {
+            w[0] = w[1] = w[2] = 0.0;
+            c = 0;
+         }
+         if( cell )
+            cell[j] = c;
+         if( weight )
+            for( k = 0 ; k < 3 ; k++ )
+               weight[ 3*j+k ] = w[k];
+      }
+      outside += out;
+   } );
+
+   return outside;
+}
+
+/***********************************************************************
+   solution transfer
+ ***********************************************************************/
+
+int
+mesh2d::transfer_weights( mesh2d& from, int *cell, int *node, double *weight, int threads )
+{
+   node2d_list::iterator itn;
+   cell2d_set::iterator itc;
+   cell2d *c;
+   int num, num_cells, outside, i, k;
+
+   if( is_out_of_core() )
+   {
+      printf( "mesh2d::transfer_weights: not with the out-of-core store.\n" );
+      return -1;
+   }
+
+   num = mesh_nodes.size();
+   if( num == 0 )
+      return 0;
+   vector<double> x( num ), y( num ), w( 3 * num );
+   vector<cell2d*> found( num );
+
+   for( itn = mesh_nodes.begin(), i = 0 ; itn != mesh_nodes.end() ; itn++, i++ )
+   {
+      x[i] = (*itn)->p.x;
+      y[i] = (*itn)->p.y;
+   }
+   outside = from.locate( num, &x[0], &y[0], &found[0], &w[0], true, threads );
+   if( outside < 0 )
+      return -1;
+   //
+   // the indices of export_arrays
+   //
+   num_cells = from.mesh_cells.size();
+   for( itn = from.mesh_nodes.begin(), i = 0 ; itn != from.mesh_nodes.end() ; itn++, i++ )
+      (*itn)->id = i;
+   for( itc = from.mesh_cells.begin(), i = num_cells ; itc != from.mesh_cells.end() ; itc++ )
+      (*itc)->id = i--;
+
+   for( i = 0 ; i < num ; i++ )
+   {
+      c = found[i];
+      if( cell )
+         cell[i] = num_cells - c->id;
+      for( k = 0 ; k < 3 ; k++ )
+      {
+         if( node )
+            node[ 3*i+k ] = c->face[k].node->id;
+         if( weight )
+            weight[ 3*i+k ] = w[ 3*i+k ];
+      }
+   }
+
+   printf( "Transfer: %i nodes, %i outside the old mesh\n", num, outside );
+   return outside;
+}
+
+//***EOF************************************************************************
@@ -1,6 +1,6 @@
-HEADERS   = bc2d.h  common.h  efread.h  getpot.h  stopwatch.h  t_mesh2d_aux_funcs.h  t_mesh2d.h
+HEADERS   = bc2d.h  common.h  efread.h  getpot.h  stopwatch.h  t_mesh2d_aux_funcs.h  t_mesh2d.h  t_mesh2d_front.h  t_mesh2d_thread.h
 
-SOURCES   = efread.cpp  front_from_file.cpp  t_mesh2d_dump.cpp  t_mesh2d_fist.cpp  t_mesh2d_gen.cpp  t_mesh2d_stream.cpp
+SOURCES   = efread.cpp  front_from_file.cpp  t_mesh2d_adapt.cpp  t_mesh2d_coarsen.cpp  t_mesh2d_dump.cpp  t_mesh2d_fist.cpp  t_mesh2d_front.cpp  t_mesh2d_gen.cpp  t_mesh2d_parallel.cpp  t_mesh2d_partition.cpp  t_mesh2d_refine.cpp  t_mesh2d_remesh.cpp  t_mesh2d_size.cpp  t_mesh2d_stream.cpp  t_mesh2d_transfer.cpp
 
 TARGET    = mesh2d_V2
 
@@ -12,7 +12,7 @@ DEPENDPATH =
 
 CONFIG = release warn_on
 
-LIBS =
+LIBS = -lpthread
 
 TMAKE_CFLAGS_RELEASE	= -O3 -g0
 TMAKE_CFLAGS_DEBUG	  = -g0 -O3